@@ -0,0 +1,386 @@
+/*
+ *  Michael Curley
+ *  batch.c
+ */
+
+
+#include "carcade.h"
+#include "chopper.h"
+#include "snake.h"
+#include "tron.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// the worker threads, one per core if unset
+#define BATCH_THREADS_ARG   "-threads"
+
+// the games a worker takes off the front of its own range at a time, thieves
+// take half of what is left off the back
+#define BATCH_CHUNK         16
+
+// the size of a cache line, worker state written on the hot path stays on
+// lines of its own
+#define BATCH_CACHE_LINE    64
+
+// the buckets of a distribution, every power of two is split in 1 << SUB_BITS
+// so a value is kept to within 1/16 of itself
+#define BATCH_SUB_BITS      4
+#define BATCH_BUCKETS       ((64 - BATCH_SUB_BITS + 1) << BATCH_SUB_BITS)
+
+// the output lines, one json object per line
+#define BATCH_RUN_FORMAT    "{\"game\":\"%s\",\"seed\":%u,\"games\":%lld,\"threads\":%d," \
+    "\"steals\":%lld,\"seconds\":%.6f,\"games_per_sec\":%.0f}\n"
+#define BATCH_METRIC_FORMAT "{\"game\":\"%s\",\"metric\":\"%s\",\"min\":%lld,\"mean\":%.3f," \
+    "\"stddev\":%.3f,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"max\":%lld}\n"
+
+
+// ----- static globals --------------------------------------------------------
+
+
+// the games that can be run and their setup functions
+static const struct batch_game_t {
+    const char* name;
+    int (*setup)(struct carcade_t* data, int argc, char** argv);
+} Games[] = {
+    { SNAKE_ARG, new_snake },
+    { TRON_ARG, new_tron },
+    { CHOPPER_ARG, new_chopper },
+};
+
+// the metrics kept for every game
+enum e_metric {
+    metric_score,
+    metric_ticks,
+    metric_nsec,
+    metric_count
+};
+
+// the names the metrics are reported with
+static const char* Metric_Names[metric_count] = {
+    "score", "ticks", "nsec"
+};
+
+// a distribution of one metric
+struct dist_t {
+    long long count;
+    long long min;
+    long long max;
+    double sum;
+    double sum_squares;
+    long long buckets[BATCH_BUCKETS];
+};
+
+// a worker thread and the games it owns
+// note:
+//  - the games still to play are the indexes [begin, end) packed in one word
+//    so the owner and the thieves can both take from it with a swap
+//  - only thieves read another worker's range, the distributions and the
+//    game instance are only touched by their own thread until it is joined
+struct worker_t {
+    _Alignas(BATCH_CACHE_LINE) _Atomic uint64_t range;
+    _Alignas(BATCH_CACHE_LINE) pthread_t thread;
+    int id;
+    int failed;
+    long long steals;
+    struct carcade_t data;
+    struct dist_t dists[metric_count];
+};
+
+// the batch shared by every worker, written before they start
+static const struct batch_game_t* Game;
+static int Argc;
+static char** Argv;
+static unsigned int Seed;
+static int Thread_Count;
+static struct worker_t* Workers;
+
+
+
+// ----- static functions ------------------------------------------------------
+
+
+// returns the current monotonic time in nanoseconds
+static inline long long now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// packs and unpacks a range of game indexes
+static inline uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)begin << 32 | end;
+}
+static inline uint32_t range_begin(uint64_t range) {
+    return range >> 32;
+}
+static inline uint32_t range_end(uint64_t range) {
+    return (uint32_t)range;
+}
+
+// gets the bucket of a value, small values get one each
+static inline int bucket_of(long long value) {
+    int shift;
+    if (value < (1 << BATCH_SUB_BITS)) {
+        return value < 0 ? 0 : value;
+    }
+    shift = 63 - __builtin_clzll(value) - BATCH_SUB_BITS;
+    return ((shift + 1) << BATCH_SUB_BITS) + ((value >> shift) & ((1 << BATCH_SUB_BITS) - 1));
+}
+
+// gets the smallest value that lands in a bucket
+static inline long long bucket_value(int bucket) {
+    int shift = (bucket >> BATCH_SUB_BITS) - 1;
+    if (shift < 0) {
+        return bucket;
+    }
+    return ((long long)(bucket & ((1 << BATCH_SUB_BITS) - 1)) | (1 << BATCH_SUB_BITS)) << shift;
+}
+
+// adds a value to a distribution
+static inline void add_value(struct dist_t* dist, long long value) {
+    if (!dist->count || value < dist->min) {
+        dist->min = value;
+    }
+    if (!dist->count || value > dist->max) {
+        dist->max = value;
+    }
+    dist->count++;
+    dist->sum += value;
+    dist->sum_squares += (double)value * value;
+    dist->buckets[bucket_of(value)]++;
+}
+
+// adds one distribution into another
+static void merge_dist(struct dist_t* into, struct dist_t* from) {
+    if (!from->count) {
+        return;
+    }
+    if (!into->count || from->min < into->min) {
+        into->min = from->min;
+    }
+    if (!into->count || from->max > into->max) {
+        into->max = from->max;
+    }
+    into->count += from->count;
+    into->sum += from->sum;
+    into->sum_squares += from->sum_squares;
+    for (int i = 0; i < BATCH_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+}
+
+// gets the value a percent of the distribution is at or below, to within
+// its bucket
+static long long percentile(struct dist_t* dist, int percent) {
+    long long rank = (dist->count * percent + 99) / 100;
+    long long seen = 0;
+    for (int i = 0; i < BATCH_BUCKETS; i++) {
+        seen += dist->buckets[i];
+        if (seen >= rank && seen) {
+            long long value = bucket_value(i);
+            return value < dist->min ? dist->min : value > dist->max ? dist->max : value;
+        }
+    }
+    return dist->max;
+}
+
+// takes the next chunk of games off the front of a worker's own range,
+// returns 0 once it is empty
+static inline int take_games(struct worker_t* worker, uint32_t* begin, uint32_t* end) {
+    uint64_t range = atomic_load_explicit(&worker->range, memory_order_relaxed);
+    uint32_t b;
+    uint32_t e;
+    do {
+        b = range_begin(range);
+        e = range_end(range);
+        if (b >= e) {
+            return 0;
+        }
+        *begin = b;
+        *end = e - b > BATCH_CHUNK ? b + BATCH_CHUNK : e;
+    } while (!atomic_compare_exchange_weak_explicit(&worker->range, &range,
+                pack_range(*end, e), memory_order_acquire, memory_order_relaxed));
+    return 1;
+}
+
+// steals half of the games left to another worker into a worker's own empty
+// range, returns 0 once every other worker is out of games
+static int steal_games(struct worker_t* worker) {
+    for (int i = 1; i < Thread_Count; i++) {
+        struct worker_t* victim = &Workers[(worker->id + i) % Thread_Count];
+        uint64_t range = atomic_load_explicit(&victim->range, memory_order_relaxed);
+        uint32_t b = range_begin(range);
+        uint32_t e = range_end(range);
+        uint32_t split;
+        while (b < e) {
+            split = e - (e - b + 1) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range,
+                        pack_range(b, split), memory_order_acquire, memory_order_relaxed)) {
+                atomic_store_explicit(&worker->range, pack_range(split, e), memory_order_release);
+                worker->steals++;
+                return 1;
+            }
+            b = range_begin(range);
+            e = range_end(range);
+        }
+    }
+    return 0;
+}
+
+// plays one game from its seed and adds it to the worker's distributions
+static inline void play_game(struct worker_t* worker, uint32_t index) {
+    struct carcade_t* data = &worker->data;
+    long long ticks = 0;
+    long long start = now_ns();
+    int ret;
+    seed_game(data, Seed + index);
+    new_game(data);
+    do {
+        ret = paint(data);
+        ticks++;
+    } while (ret == 0);
+    add_value(&worker->dists[metric_score], data->score);
+    add_value(&worker->dists[metric_ticks], ticks);
+    add_value(&worker->dists[metric_nsec], now_ns() - start);
+    game_over(data);
+}
+
+// plays games until there are none left to take or steal
+static void* run_worker(void* arg) {
+    struct worker_t* worker = arg;
+    uint32_t begin;
+    uint32_t end;
+    set_data(&worker->data, Argc, Argv);
+    if ((*Game->setup)(&worker->data, Argc, Argv) == CARCADE_GAME_QUIT ||
+            start_carcade(&worker->data) == CARCADE_GAME_QUIT) {
+        worker->failed = 1;
+        return NULL;
+    }
+    do {
+        while (take_games(worker, &begin, &end)) {
+            for (uint32_t i = begin; i < end; i++) {
+                play_game(worker, i);
+            }
+        }
+    } while (steal_games(worker));
+    stop_carcade(&worker->data);
+    return NULL;
+}
+
+// prints the usage
+static void print_usage(const char* name) {
+    printf("usage: %s <game> [carcade and game arguments]\n\t"
+            "plays headless games spread over every core and reports the\n\t"
+            "score, ticks and nanoseconds of the games as distributions\n\t"
+            GAMES_ARG         "\t\tint  - the number of games, played from consecutive seeds\n\t"
+            SEED_ARG          "\t\tint  - the seed of the first game, 0 for time based\n\t"
+            BATCH_THREADS_ARG "\tint  - the worker threads, 0 for one per core\n\n", name);
+}
+
+
+
+// ----- main ------------------------------------------------------------------
+
+
+// plays a batch of games of one module over a pool of worker threads
+int main(int argc, char** argv) {
+    struct carcade_t data;
+    struct dist_t* total;
+    long long start;
+    long long steals = 0;
+    double seconds;
+    int failed = 0;
+    int threads = 0;
+    for (size_t g = 0; argc > 1 && g < sizeof(Games) / sizeof(*Games); g++) {
+        if (!strcmp(argv[1], Games[g].name)) {
+            Game = &Games[g];
+        }
+    }
+    for (int i = 1; i < argc - 1; i++) {
+        if (!strcmp(argv[i], BATCH_THREADS_ARG)) {
+            threads = atoi(argv[++i]);
+        }
+    }
+    if (!Game || threads < 0) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    // every worker runs headless without a screen and keeps quiet
+    Argv = calloc(argc + 5, sizeof(*Argv));
+    memcpy(Argv, argv, argc * sizeof(*argv));
+    Argc = argc;
+    Argv[Argc++] = HEADLESS_ARG;
+    Argv[Argc++] = RENDER_ARG;
+    Argv[Argc++] = RENDER_NONE_NAME;
+    Argv[Argc++] = QUIET_ARG;
+    set_data(&data, Argc, Argv);
+    if (data.record || data.replay || data.games < 1) {
+        printf("error: something went wrong with the batch arguments\n");
+        return -1;
+    }
+    Seed = data.seed ? data.seed : time(0) ^ getpid();
+    if (!threads) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    Thread_Count = threads < data.games ? threads : data.games;
+    Thread_Count = Thread_Count < 1 ? 1 : Thread_Count;
+    Workers = aligned_alloc(BATCH_CACHE_LINE, Thread_Count * sizeof(*Workers));
+    total = calloc(metric_count, sizeof(*total));
+    if (!Workers || !total) {
+        printf("error: could not set up the workers\n");
+        return -1;
+    }
+    memset(Workers, 0, Thread_Count * sizeof(*Workers));
+    // each worker starts out owning an even share of the games
+    for (int i = 0; i < Thread_Count; i++) {
+        Workers[i].id = i;
+        atomic_init(&Workers[i].range, pack_range(
+                    (long long)data.games * i / Thread_Count,
+                    (long long)data.games * (i + 1) / Thread_Count));
+    }
+    start = now_ns();
+    for (int i = 0; i < Thread_Count; i++) {
+        if (pthread_create(&Workers[i].thread, 0, run_worker, &Workers[i])) {
+            printf("error: could not start the workers\n");
+            return -1;
+        }
+    }
+    for (int i = 0; i < Thread_Count; i++) {
+        pthread_join(Workers[i].thread, NULL);
+        failed |= Workers[i].failed;
+        steals += Workers[i].steals;
+        for (int m = 0; m < metric_count; m++) {
+            merge_dist(&total[m], &Workers[i].dists[m]);
+        }
+    }
+    seconds = (now_ns() - start) / 1e9;
+    if (failed || total[metric_score].count != data.games) {
+        printf("error: something went wrong with the %s games\n", Game->name);
+        return -1;
+    }
+    printf(BATCH_RUN_FORMAT, Game->name, Seed, total[metric_score].count, Thread_Count,
+            steals, seconds, seconds > 0 ? total[metric_score].count / seconds : 0);
+    for (int m = 0; m < metric_count; m++) {
+        double mean = total[m].sum / total[m].count;
+        double variance = total[m].sum_squares / total[m].count - mean * mean;
+        printf(BATCH_METRIC_FORMAT, Game->name, Metric_Names[m], total[m].min, mean,
+                variance > 0 ? sqrt(variance) : 0, percentile(&total[m], 50),
+                percentile(&total[m], 90), percentile(&total[m], 99), total[m].max);
+    }
+    free(total);
+    free(Workers);
+    free(Argv);
+    return 0;
+}
+
+
+
+// ----- end of file -----------------------------------------------------------
@@ -0,0 +1,186 @@
+/*
+ *  Michael Curley
+ *  bench.c
+ */
+
+
+#include "carcade.h"
+#include "chopper.h"
+#include "snake.h"
+#include "tron.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// the default ticks played per case and the seed of the first case
+#define BENCH_DEFAULT_TICKS 200000
+#define BENCH_DEFAULT_SEED  1
+
+// the snapshots saved and restored at the end of each case to time them
+#define BENCH_SNAPSHOTS     100000
+
+// the output line of each case, one json object per line
+#define BENCH_RESULT_FORMAT "{\"game\":\"%s\",\"width\":%d,\"height\":%d," \
+    "\"render\":\"%s\",\"seed\":%u,\"games\":%d,\"ticks\":%lld,\"seconds\":%.6f," \
+    "\"ticks_per_sec\":%.0f,\"ns_per_tick\":%.1f,\"bytes_per_frame\":%.1f," \
+    "\"save_ns\":%.1f,\"restore_ns\":%.1f}\n"
+
+
+// ----- static globals --------------------------------------------------------
+
+
+// the games benchmarked and their setup functions
+static const struct bench_game_t {
+    const char* name;
+    int (*setup)(struct carcade_t* data, int argc, char** argv);
+} Games[] = {
+    { SNAKE_ARG, new_snake },
+    { TRON_ARG, new_tron },
+    { CHOPPER_ARG, new_chopper },
+};
+
+// the board sizes benchmarked, from the smallest to the largest allowed
+static const int Sizes[][2] = {
+    { MIN_WIDTH, MIN_HEIGHT },
+    { DEFAULT_WIDTH, DEFAULT_HEIGHT },
+    { 80, 24 },
+    { MAX_WIDTH, MAX_HEIGHT },
+};
+
+// the renderers benchmarked, none measures the engine alone
+static const char* Renders[] = {
+    RENDER_NONE_NAME,
+    RENDER_ANSI_NAME,
+};
+
+// where the results go, stdout itself is pointed at /dev/null so the ansi
+// frames and headless reports are discarded
+static FILE* Results;
+
+// the snapshot timed at the end of each case
+static struct snapshot_t Snapshot;
+
+
+
+// ----- static functions ------------------------------------------------------
+
+
+// returns the current monotonic time in seconds
+static double now_sec(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// plays headless games of one case until the tick budget is spent and
+// reports the result, returns non-zero if the case could not start
+static int bench_case(const struct bench_game_t* game, int width, int height,
+                      const char* render, unsigned int seed, long long budget) {
+    int ret;
+    int games = 0;
+    long long ticks = 0;
+    long long bytes = rendered_bytes();
+    double start;
+    double seconds;
+    double saved;
+    double restored;
+    char width_arg[MAX_STRLEN];
+    char height_arg[MAX_STRLEN];
+    char seed_arg[MAX_STRLEN];
+    char ticks_arg[MAX_STRLEN];
+    char* argv[] = {
+        "carcade-bench", (char*)game->name,
+        WIDTH_ARG, width_arg, HEIGHT_ARG, height_arg, SPEED_ARG, "10",
+        HEADLESS_ARG, RENDER_ARG, (char*)render, SEED_ARG, seed_arg,
+        GAMES_ARG, "2147483647", TICKS_ARG, ticks_arg,
+    };
+    int argc = sizeof(argv) / sizeof(*argv);
+    struct carcade_t data;
+    sprintf(width_arg, "%d", width);
+    sprintf(height_arg, "%d", height);
+    sprintf(seed_arg, "%u", seed);
+    sprintf(ticks_arg, "%lld", budget);
+    set_data(&data, argc, argv);
+    if ((*game->setup)(&data, argc, argv) == CARCADE_GAME_QUIT ||
+            start_carcade(&data) == CARCADE_GAME_QUIT) {
+        return -1;
+    }
+    // same loop as the game itself, stopping once the budget is spent
+    start = now_sec();
+    while (ticks < budget && game_over(&data) != CARCADE_GAME_QUIT) {
+        new_game(&data);
+        games++;
+        do {
+            ret = paint(&data);
+            ticks++;
+        } while (ret == 0 && ticks < budget);
+    }
+    seconds = now_sec() - start;
+    // save and restore the game as it was left
+    start = now_sec();
+    for (int i = 0; i < BENCH_SNAPSHOTS; i++) {
+        save_game(&data, &Snapshot);
+    }
+    saved = now_sec() - start;
+    start = now_sec();
+    for (int i = 0; i < BENCH_SNAPSHOTS; i++) {
+        restore_game(&data, &Snapshot);
+    }
+    restored = now_sec() - start;
+    stop_carcade(&data);
+    bytes = rendered_bytes() - bytes;
+    fprintf(Results, BENCH_RESULT_FORMAT, game->name, width, height, render,
+            seed, games, ticks, seconds, ticks / seconds, seconds * 1e9 / ticks,
+            (double)bytes / ticks, saved * 1e9 / BENCH_SNAPSHOTS,
+            restored * 1e9 / BENCH_SNAPSHOTS);
+    fflush(Results);
+    return 0;
+}
+
+
+
+// ----- main ------------------------------------------------------------------
+
+
+// runs every game at every size with every renderer
+// usage: carcade-bench [ticks per case] [seed]
+int main(int argc, char** argv) {
+    int null_fd;
+    long long budget = argc > 1 ? atoll(argv[1]) : BENCH_DEFAULT_TICKS;
+    unsigned int seed = argc > 2 ? strtoul(argv[2], NULL, 10) : BENCH_DEFAULT_SEED;
+    if (budget < 1 || !seed) {
+        printf("usage: %s [ticks per case] [seed]\n", argv[0]);
+        return -1;
+    }
+    // keep the results on the real stdout, discard everything else
+    Results = fdopen(dup(STDOUT_FILENO), "w");
+    null_fd = open("/dev/null", O_WRONLY);
+    if (!Results || null_fd < 0) {
+        printf("error: could not set up the output\n");
+        return -1;
+    }
+    fflush(stdout);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    for (size_t g = 0; g < sizeof(Games) / sizeof(*Games); g++) {
+        for (size_t s = 0; s < sizeof(Sizes) / sizeof(*Sizes); s++) {
+            for (size_t r = 0; r < sizeof(Renders) / sizeof(*Renders); r++) {
+                if (bench_case(&Games[g], Sizes[s][0], Sizes[s][1], Renders[r],
+                            seed, budget)) {
+                    fprintf(stderr, "error: could not run %s %dx%d\n",
+                            Games[g].name, Sizes[s][0], Sizes[s][1]);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+
+
+// ----- end of file -----------------------------------------------------------
@@ -5,249 +5,2010 @@
 
 
 #include "carcade.h"
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <ncurses.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 
 // ----- static globals --------------------------------------------------------
 
 
-// flag indicates if the game is running and if game has been quit
-static int Flag_Running;
-static int Flag_Quit;
-static int Flag_Kill_Thread;
-static int Flag_Paint_Count;
+// flags requesting a full redraw of the screen on the next paint, set by the
+// refresh key, a terminal resize or a failed curses update
+static volatile sig_atomic_t Flag_Redraw;
+static volatile sig_atomic_t Flag_Resize;
 
-// the thread-shared next keystroke to process
+// a keystroke read by the input thread and when it was read
+struct keystroke_t {
+    enum e_keystroke key;
+    enum e_keystroke clear;
+    struct timespec stamp;
+};
+
+// the single producer/single consumer ring of keystrokes from the input thread
+// to the game loop
 // note:
-//  - not protecting with a lock since we want this to go as fast as possible,
-//    in hopes that the game is rendered quick enough that missing a keystroke
-//    over a delay period does not matter
-static enum e_keystroke Next;
+//  - the input thread only writes head and the game loop only writes tail, so
+//    no lock is needed and the indices sit on their own cache lines
+//  - the indices run freely and are masked on access
+struct key_queue_t {
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) atomic_uint tail;
+    struct keystroke_t keys[KEY_QUEUE_SIZE];
+};
 
-// the data specific to the game set up
-static struct carcade_t* Data;
+// the escape sequence parsing state of the keyboard input
+enum e_key_state {
+    key_state_ascii,
+    key_state_escape,
+    key_state_arrow,
+};
 
-// the keystroke processing thread
-static pthread_t Key_Thread;
+// the fixed size start of a recording, followed by the recorded arguments
+// each as a 16 bit length and its characters
+struct record_header_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t seed;
+    int32_t width;
+    int32_t height;
+    int32_t speed;
+    int32_t keep_score;
+    char title_char;
+    char corner_char;
+    char horizontal_char;
+    char vertical_char;
+    char clear_char;
+    char padding[3];
+    uint32_t argc;
+};
 
+// the scoreboard values last painted, redrawn only when one of these changes
+struct scoreboard_t {
+    int valid;
+    int keep_score;
+    int score;
+    int width;
+    int height;
+    int speed;
+};
 
+// a square of a world, freed once only the board fill is left in it and no
+// cell of it is occupied
+struct chunk_t {
+    // the cells painted with anything but the board fill
+    int used;
+    // the cells occupied by the game and a bit for each, row by row
+    int occupied;
+    uint64_t bits[WORLD_CHUNK_SIZE];
+    char cells[WORLD_CHUNK_SIZE][WORLD_CHUNK_SIZE];
+};
+_Static_assert(WORLD_CHUNK_SIZE == 64, "a chunk row of occupied cells is not a word");
 
-// ----- static functions ------------------------------------------------------
+// the performance overlay, samples are only taken while it is shown
+// note:
+//  - each window holds the nanoseconds of the last HUD_WINDOW ticks, late is
+//    how far past the deadline the tick woke up
+struct hud_t {
+    int shown;
+    int drawn;
+    long long count;
+    // the count the overlay was last painted at
+    long long updated;
+    long long start[HUD_WINDOW];
+    long long move[HUD_WINDOW];
+    long long paint[HUD_WINDOW];
+    long long late[HUD_WINDOW];
+};
 
+// a frame encoded once for every spectator, freed once the last one sent it
+struct frame_t {
+    int refs;
+    int len;
+    char buf[];
+};
 
-// adds the title to the data board, returns the pointer to the next row
-static int set_title(void) {
-    int col = 0;
-    int title_len = strlen(Data->title);
-    // title in the middle
-    int title_start = (Data->width / 2) - (title_len / 2);
-    // board has edges so add the leading one
-    mvaddch(0, col++, Data->title_char);
-    // fill in title characters until the title string
-    for (int i = 0; i < Data->width; i++) {
-        if (i == title_start) {
-            mvaddstr(0, col, Data->title);
-            col += title_len;
-            i += title_len - 1;
+// a spectator and the frames queued for it
+struct spectator_t {
+    int fd;
+    // bool, the queued frames were dropped and a keyframe is owed
+    int behind;
+    // the bytes of the oldest frame already sent
+    int sent;
+    unsigned int head;
+    unsigned int tail;
+    struct frame_t* frames[SPECTATE_QUEUE];
+};
+
+// the frames published to spectators
+// note:
+//  - each paint the cells that changed since the last published frame are
+//    encoded once and the same frame is queued for every spectator
+//  - spectators are only written to without blocking, one that falls
+//    SPECTATE_QUEUE frames behind has its queue dropped and is sent a
+//    keyframe of the whole screen, like a new spectator
+struct spectate_t {
+    // the listening socket, -1 if not published
+    int fd;
+    int count;
+    struct spectator_t viewers[SPECTATE_MAX];
+    // the board and scoreboard as the spectators see them and the size of
+    // the view they were sent
+    char published[MAX_HEIGHT][MAX_WIDTH];
+    int width;
+    int height;
+    char scoreboard[MAX_STRLEN];
+    int scoreboard_len;
+    // the frame being encoded
+    char* buf;
+    int len;
+    int size;
+};
+
+// a screen backend, everything shown goes through one of these
+struct renderer_t {
+    // sets up the terminal, returns 0 on success
+    int (*open)(void);
+    // clears the whole screen
+    void (*clear)(void);
+    // draws len characters at the screen row/col, returns 0 on success
+    int (*text)(int row, int col, const char* str, int len);
+    // moves the len characters at the screen row/col one to the left,
+    // leaving a blank in the last one
+    void (*shift)(int row, int col, int len);
+    // shows everything drawn since the last flush, returns 0 on success
+    int (*flush)(void);
+    // the terminal has been resized to rows x cols
+    void (*resize)(int rows, int cols);
+    // returns the next typed character or ERR if none arrives within the
+    // timeout, a negative timeout waits forever
+    int (*key)(int timeout_ms);
+    // restores the terminal
+    void (*close)(void);
+};
+
+// the size of the screen the backends draw on
+static int Screen_Rows;
+static int Screen_Cols;
+
+// the ansi frame being built, sent with a single write() per flush
+static struct ansi_t {
+    char* buf;
+    int len;
+    int size;
+    // the cursor position after the last sequence, -1 if unknown
+    int row;
+    int col;
+    // the total bytes written
+    long long bytes;
+    // the terminal settings to restore, if stdin was a terminal
+    int raw;
+    struct termios saved;
+} Ansi;
+
+// the terminal output, written out by its own thread so a slow terminal never
+// holds up a tick
+// note:
+//  - stdout is swapped for a pipe while playing, whatever the renderers write
+//    goes through it and what the thread has yet to write is the backlog
+//    frames are dropped on
+static struct screen_out_t {
+    // the terminal, stdout until the pipe takes its place
+    int tty;
+    int pipe[2];
+    pthread_t thread;
+    // the bytes the thread took from the pipe in all and is still writing
+    atomic_llong taken;
+    atomic_int writing;
+} Screen_Out = { .tty = STDOUT_FILENO, .pipe = { -1, -1 } };
+
+
+
+// the running state of one arcade
+struct engine_t {
+    // flags indicating if the game is running and if it has been quit
+    atomic_int running;
+    atomic_int quit;
+    atomic_int kill_thread;
+    // flag toggled by the overlay key to show or hide the performance overlay
+    atomic_int show_hud;
+
+    // the keystroke(s) handed to the next move, only touched by the game loop
+    enum e_keystroke next;
+    // the keystrokes from the input thread, the thread itself and the event
+    // loop descriptors, stdin and the tick timer are waited on together
+    struct key_queue_t keys;
+    pthread_t key_thread;
+    int event_fd;
+    int timer_fd;
+    enum e_key_state key_state;
+
+    // the absolute monotonic deadline of the next tick
+    struct timespec next_tick;
+    // the game time and ticks of the current game
+    long long game_nsec;
+    long long game_ticks;
+    // the headless games played, their total ticks and when the first started
+    int games_played;
+    long long total_ticks;
+    struct timespec start_time;
+
+    // the headless keystroke script and the next tick's position in it
+    char* script;
+    long script_len;
+    long script_pos;
+    // the headless random input state and the game's own random state
+    unsigned int input_seed;
+    unsigned int rand_seed;
+
+    // the recording written during play, the keystroke mask waiting to be
+    // written and for how many ticks in a row it was handed to a move
+    FILE* record_file;
+    enum e_keystroke record_mask;
+    uint32_t record_run;
+    // the recording played back, the keystroke mask being replayed and the
+    // ticks it has left, and the games that did not end as recorded
+    FILE* replay_file;
+    struct record_header_t replay_header;
+    enum e_keystroke replay_mask;
+    uint32_t replay_run;
+    int replay_diverged;
+
+    // the game state grid, the source of truth for every painted board cell
+    // note:
+    //  - the renderer is only used to show the board, collisions and other
+    //    game logic read back from here
+    //  - a world is kept in its chunks instead, this holds the view of it and
+    //    what is painted in view is copied here
+    //  - each row is a ring of view_width cells starting at the origin and
+    //    kept twice over, so a scroll only moves the origin and the cells from
+    //    it on are always one unbroken run
+    char board[MAX_HEIGHT][2 * MAX_WIDTH];
+    int board_origin;
+    // the last frame pushed to the renderer and the rows of the grid that may
+    // differ from it, only the changed cells of dirty rows are sent each paint
+    // note:
+    //  - rows are rings like the grid's but each scrolls on its own, with the
+    //    neighboring cells that differ counted to tell if a scroll is worth it
+    char shown[MAX_HEIGHT][2 * MAX_WIDTH];
+    int shown_origin[MAX_HEIGHT];
+    int shown_changes[MAX_HEIGHT];
+    char dirty[MAX_HEIGHT];
+    // the left shifts of each board row not yet applied to the screen, and
+    // those of dropped frames that the spectators were already sent
+    int shifts[MAX_HEIGHT];
+    int held_shifts[MAX_HEIGHT];
+    // the frames not shown because the terminal had fallen behind more than
+    // the bytes of the last frame shown
+    long long dropped;
+    long long frame_bytes;
+    // the screen row/col the title starts at, the board and scoreboard are
+    // centered on the terminal and laid out again whenever it is resized
+    int top;
+    int left;
+    // bool, the terminal is too small for the board and nothing is painted
+    // until it is resized
+    int hidden;
+    // the size of the board shown and where it starts in the world, the whole
+    // board unless it is a world
+    int view_width;
+    int view_height;
+    int view_row;
+    int view_col;
+    // the chunks of a world row by row, null where nothing is painted, and
+    // how many are allocated now and at most
+    struct chunk_t** chunks;
+    int chunk_cols;
+    int chunk_count;
+    int chunk_peak;
+    struct scoreboard_t scoreboard;
+    struct hud_t hud;
+    // the spectators watching
+    struct spectate_t spectate;
+
+    // the screen backend
+    const struct renderer_t* renderer;
+};
+
+// the arguments of a replay, kept for the life of the process like argv
+static char** Replay_Argv;
+
+// ----- renderers -------------------------------------------------------------
+
+
+// sets up the curses screen
+static int curses_open(void) {
+    initscr();
+    cbreak();
+    noecho();
+    curs_set(0);
+    Screen_Rows = LINES;
+    Screen_Cols = COLS;
+    return 0;
+}
+
+// clears the curses screen
+static void curses_clear(void) {
+    clear();
+}
+
+// draws text on the curses screen
+static int curses_text(int row, int col, const char* str, int len) {
+    return mvaddnstr(row, col, str, len) == ERR ? -1 : 0;
+}
+
+// shifts part of a curses row by deleting a character and inserting one
+static void curses_shift(int row, int col, int len) {
+    mvdelch(row, col);
+    mvinsch(row, col + len - 1, ' ');
+}
+
+// refreshes the curses screen
+static int curses_flush(void) {
+    return refresh() == ERR ? -1 : 0;
+}
+
+// lets curses know the new size without re-initializing it
+static void curses_resize(int rows, int cols) {
+    resizeterm(rows, cols);
+    Screen_Rows = LINES;
+    Screen_Cols = COLS;
+}
+
+// reads a key through curses
+static int curses_key(int timeout_ms) {
+    timeout(timeout_ms);
+    return getch();
+}
+
+// clears the screen and ends the curses window
+static void curses_close(void) {
+    clear();
+    refresh();
+    curs_set(1);
+    endwin();
+}
+
+// the curses backend
+static const struct renderer_t Curses_Renderer = {
+    curses_open, curses_clear, curses_text, curses_shift, curses_flush,
+    curses_resize, curses_key, curses_close,
+};
+
+// makes room for len more bytes in the ansi frame
+static inline void ansi_reserve(int len) {
+    if (Ansi.len + len > Ansi.size) {
+        Ansi.size = (Ansi.len + len) * 2;
+        Ansi.buf = realloc(Ansi.buf, Ansi.size);
+    }
+}
+
+// appends bytes to the ansi frame, the frame starts synchronized output
+static inline void ansi_append(const char* str, int len) {
+    if (!Ansi.len) {
+        ansi_reserve(sizeof(ANSI_SYNC_BEGIN) - 1);
+        memcpy(Ansi.buf, ANSI_SYNC_BEGIN, sizeof(ANSI_SYNC_BEGIN) - 1);
+        Ansi.len = sizeof(ANSI_SYNC_BEGIN) - 1;
+    }
+    ansi_reserve(len);
+    memcpy(Ansi.buf + Ansi.len, str, len);
+    Ansi.len += len;
+}
+
+// appends a control sequence with a single number to the ansi frame
+static inline void ansi_sequence(const char* format, int n) {
+    char seq[MAX_STRLEN];
+    ansi_append(seq, sprintf(seq, format, n));
+}
+
+// moves the ansi cursor, a forward move on the same row is the cheapest
+static inline void ansi_move(int row, int col) {
+    char seq[MAX_STRLEN];
+    if (Ansi.row == row && Ansi.col == col) {
+        return;
+    }
+    if (Ansi.row == row && Ansi.col >= 0 && Ansi.col < col) {
+        ansi_sequence(ANSI_FORWARD_FORMAT, col - Ansi.col);
+    }
+    else {
+        ansi_append(seq, sprintf(seq, ANSI_MOVE_FORMAT, row + 1, col + 1));
+    }
+    Ansi.row = row;
+    Ansi.col = col;
+}
+
+// sets up the terminal for ansi output, raw input if it is a terminal
+static int ansi_open(void) {
+    struct termios raw;
+    struct winsize size;
+    Ansi.raw = !tcgetattr(STDIN_FILENO, &Ansi.saved);
+    if (Ansi.raw) {
+        raw = Ansi.saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    Screen_Rows = MAX_HEIGHT + CHAR_BOARD_HEIGHT(0) + 1;
+    Screen_Cols = MAX_WIDTH + (2 * CHAR_BORDER_WIDTH);
+    if (!ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) && size.ws_row && size.ws_col) {
+        Screen_Rows = size.ws_row;
+        Screen_Cols = size.ws_col;
+    }
+    Ansi.len = 0;
+    Ansi.row = -1;
+    Ansi.col = -1;
+    ansi_append(ANSI_ENTER, sizeof(ANSI_ENTER) - 1);
+    return 0;
+}
+
+// clears the ansi screen
+static void ansi_clear(void) {
+    ansi_append(ANSI_CLEAR, sizeof(ANSI_CLEAR) - 1);
+    Ansi.row = 0;
+    Ansi.col = 0;
+}
+
+// draws text in the ansi frame
+// note:
+//  - runs of one character are compressed, spaces are erased in place with
+//    ECH and other characters are repeated with REP
+static int ansi_text(int row, int col, const char* str, int len) {
+    int run;
+    ansi_move(row, col);
+    for (int i = 0; i < len; i += run) {
+        for (run = 1; i + run < len && str[i + run] == str[i]; run++);
+        if (run < ANSI_MIN_RUN) {
+            ansi_append(str + i, run);
+            Ansi.col += run;
+        }
+        else if (str[i] == ' ') {
+            // erasing leaves the cursor in place
+            ansi_sequence(ANSI_ERASE_FORMAT, run);
+            if (i + run < len) {
+                ansi_sequence(ANSI_FORWARD_FORMAT, run);
+                Ansi.col += run;
+            }
         }
         else {
-            mvaddch(0, col++, Data->title_char);
+            ansi_append(str + i, 1);
+            ansi_sequence(ANSI_REPEAT_FORMAT, run - 1);
+            Ansi.col += run;
+        }
+    }
+    // writing the last column leaves the cursor position up to the terminal
+    if (Ansi.col >= Screen_Cols) {
+        Ansi.row = -1;
+        Ansi.col = -1;
+    }
+    return 0;
+}
+
+// shifts part of an ansi row, the cursor stays where it is for both
+static void ansi_shift(int row, int col, int len) {
+    ansi_move(row, col);
+    ansi_append(ANSI_DELETE_CHAR, sizeof(ANSI_DELETE_CHAR) - 1);
+    ansi_move(row, col + len - 1);
+    ansi_append(ANSI_INSERT_CHAR, sizeof(ANSI_INSERT_CHAR) - 1);
+}
+
+// writes out the ansi frame with a single write() when it is not interrupted
+static int ansi_flush(void) {
+    int off = 0;
+    int ret;
+    if (!Ansi.len) {
+        return 0;
+    }
+    ansi_append(ANSI_SYNC_END, sizeof(ANSI_SYNC_END) - 1);
+    while (off < Ansi.len) {
+        ret = write(STDOUT_FILENO, Ansi.buf + off, Ansi.len - off);
+        if (ret < 0 && errno != EINTR) {
+            Ansi.len = 0;
+            return -1;
         }
+        off += ret > 0 ? ret : 0;
+    }
+    Ansi.bytes += Ansi.len;
+    Ansi.len = 0;
+    return 0;
+}
+
+// the ansi screen size changed
+static void ansi_resize(int rows, int cols) {
+    Screen_Rows = rows;
+    Screen_Cols = cols;
+    Ansi.row = -1;
+    Ansi.col = -1;
+}
+
+// reads a key straight from stdin
+static int ansi_key(int timeout_ms) {
+    unsigned char ch;
+    struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&fd, 1, timeout_ms) != 1 || read(STDIN_FILENO, &ch, 1) != 1) {
+        return ERR;
+    }
+    return ch;
+}
+
+// clears the screen and restores the terminal
+static void ansi_close(void) {
+    ansi_clear();
+    ansi_append(ANSI_LEAVE, sizeof(ANSI_LEAVE) - 1);
+    ansi_flush();
+    if (Ansi.raw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &Ansi.saved);
     }
-    // add the trailing edge
-    mvaddch(0, col, Data->title_char);
+    free(Ansi.buf);
+    Ansi.buf = NULL;
+    Ansi.size = 0;
+}
+
+// the ansi backend
+static const struct renderer_t Ansi_Renderer = {
+    ansi_open, ansi_clear, ansi_text, ansi_shift, ansi_flush,
+    ansi_resize, ansi_key, ansi_close,
+};
+
+// does nothing, for the backend without a screen
+static int none_open(void) {
+    return 0;
+}
+static void none_clear(void) {
+}
+static int none_text(int row, int col, const char* str, int len) {
+    return 0;
+}
+static void none_shift(int row, int col, int len) {
+}
+static int none_flush(void) {
+    return 0;
+}
+static void none_resize(int rows, int cols) {
+}
+static int none_key(int timeout_ms) {
+    return ERR;
+}
+static void none_close(void) {
+}
+
+// the backend without a screen
+static const struct renderer_t None_Renderer = {
+    none_open, none_clear, none_text, none_shift, none_flush,
+    none_resize, none_key, none_close,
+};
+
+// writes what comes through the pipe out to the terminal until the pipe is
+// closed, blocking here instead of in the game loop
+static void* write_screen(void* arg) {
+    char buf[SCREEN_WRITE_SIZE];
+    int len;
+    int off;
+    int ret;
+    while ((len = read(Screen_Out.pipe[0], buf, sizeof(buf))) != 0) {
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        Screen_Out.taken += len;
+        Screen_Out.writing = len;
+        // a terminal that fails is given up on but the pipe is still drained
+        for (off = 0; off < len; off += ret > 0 ? ret : 0) {
+            ret = write(Screen_Out.tty, buf + off, len - off);
+            if (ret < 0 && errno != EINTR) {
+                break;
+            }
+        }
+        Screen_Out.writing = 0;
+    }
+    return NULL;
+}
+
+// puts the pipe in place of stdout and starts writing it out, returns 0 on
+// success
+static int start_screen_out(void) {
+    int tty;
+    fflush(stdout);
+    if (pipe(Screen_Out.pipe)) {
+        Screen_Out.pipe[0] = Screen_Out.pipe[1] = -1;
+        return -1;
+    }
+    tty = dup(STDOUT_FILENO);
+    Screen_Out.tty = tty;
+    if (tty < 0 || pthread_create(&Screen_Out.thread, 0, write_screen, NULL)) {
+        close(Screen_Out.pipe[0]);
+        close(Screen_Out.pipe[1]);
+        if (tty >= 0) {
+            close(tty);
+        }
+        Screen_Out.tty = STDOUT_FILENO;
+        Screen_Out.pipe[0] = Screen_Out.pipe[1] = -1;
+        return -1;
+    }
+    dup2(Screen_Out.pipe[1], STDOUT_FILENO);
+    return 0;
+}
+
+// writes out everything still in the pipe and gives stdout back to the
+// terminal
+static void stop_screen_out(void) {
+    if (Screen_Out.pipe[1] < 0) {
+        return;
+    }
+    // the thread stops once both write ends are closed and it has read the
+    // rest of the pipe
+    fflush(stdout);
+    dup2(Screen_Out.tty, STDOUT_FILENO);
+    close(Screen_Out.pipe[1]);
+    pthread_join(Screen_Out.thread, NULL);
+    close(Screen_Out.pipe[0]);
+    close(Screen_Out.tty);
+    Screen_Out.tty = STDOUT_FILENO;
+    Screen_Out.pipe[0] = Screen_Out.pipe[1] = -1;
+}
+
+// returns the bytes written for the terminal that it has not taken yet, the
+// pipe, what the thread is writing and the output queue of a terminal that
+// reports one, a pty reports none
+static inline int screen_backlog(void) {
+    int piped = 0;
+    int queued = 0;
+    if (Screen_Out.pipe[0] < 0) {
+        return 0;
+    }
+    ioctl(Screen_Out.pipe[0], FIONREAD, &piped);
+    ioctl(Screen_Out.tty, TIOCOUTQ, &queued);
+    return piped + Screen_Out.writing + queued;
+}
+
+// returns the bytes written for the terminal so far, what the thread took and
+// what is still in the pipe
+static inline long long screen_written(void) {
+    long long taken;
+    int piped = 0;
+    if (Screen_Out.pipe[0] < 0) {
+        return 0;
+    }
+    // read again if the thread took some of the pipe in between
+    do {
+        taken = Screen_Out.taken;
+        ioctl(Screen_Out.pipe[0], FIONREAD, &piped);
+    } while (taken != Screen_Out.taken);
+    return taken + piped;
+}
+
+
+
+// ----- static functions ------------------------------------------------------
+
+
+// fills in the title line, returns its length
+static int format_title(struct carcade_t* data, char* line) {
+    struct engine_t* engine = data->engine;
+    int len = engine->view_width + (2 * CHAR_BORDER_WIDTH);
+    int title_len = strlen(data->title);
+    // title in the middle, board has edges so skip the leading one
+    int title_start = CHAR_BORDER_WIDTH + (engine->view_width / 2) - (title_len / 2);
+    // fill in title characters around the title string
+    memset(line, data->title_char, len);
+    memcpy(line + title_start, data->title, title_len);
+    return len;
+}
+
+// fills in a horizontal border line, returns its length
+static int format_horizontal_border(struct carcade_t* data, char* line) {
+    struct engine_t* engine = data->engine;
+    int len = engine->view_width + (2 * CHAR_BORDER_WIDTH);
+    // fill in the horizontal border between the corners
+    memset(line, data->horizontal_char, len);
+    line[0] = data->corner_char;
+    line[len - 1] = data->corner_char;
+    return len;
+}
+
+// draws text at a row/col of the board's layout on the screen
+static inline int layout_text(struct carcade_t* data, int row, int col, const char* str, int len) {
+    struct engine_t* engine = data->engine;
+    return (*engine->renderer->text)(engine->top + row, engine->left + col, str, len);
+}
+
+// adds the title to the data board, returns the pointer to the next row
+static int set_title(struct carcade_t* data) {
+    char line[MAX_WIDTH + (2 * CHAR_BORDER_WIDTH)];
+    layout_text(data, 0, 0, line, format_title(data, line));
     return 1;
 }
 
 // adds the horizontal border to the given board, returns the next row
-static int append_horizontal_border(int line) {
-    int col = 0;
-    // add the left corner
-    mvaddch(line, col++, Data->corner_char);
-    // fill in the horizontal border
-    for (int i = 0; i < Data->width; i++) {
-        mvaddch(line, col++, Data->horizontal_char);
+static int append_horizontal_border(struct carcade_t* data, int row) {
+    char line[MAX_WIDTH + (2 * CHAR_BORDER_WIDTH)];
+    layout_text(data, row, 0, line, format_horizontal_border(data, line));
+    return row + 1;
+}
+
+// gets the slot of the chunk a cell of a world is in
+static inline struct chunk_t** chunk_at(struct engine_t* engine, int row, int col) {
+    return &engine->chunks[(row / WORLD_CHUNK_SIZE) * engine->chunk_cols + col / WORLD_CHUNK_SIZE];
+}
+
+// copies cells into a ring row from the given column of the run starting at
+// its origin, both copies of each cell are written
+static inline void ring_copy(char* row, int origin, int width, int col, const char* src, int len) {
+    int pos = origin + col;
+    // the cells before the second copy starts and the ones after it
+    int low = pos >= width ? 0 : pos + len <= width ? len : width - pos;
+    memcpy(row + pos, src, low);
+    memcpy(row + pos + width, src, low);
+    if (len > low) {
+        memcpy(row + pos + low, src + low, len - low);
+        memcpy(row + pos + low - width, src + low, len - low);
     }
-    // add the right corner
-    mvaddch(line, col, Data->corner_char);
-    return line + 1;
 }
 
-// initializes the board
-static void initialize_board(void) {
+// fills cells of a ring row like ring_copy
+static inline void ring_fill(char* row, int origin, int width, int col, char c, int len) {
+    int pos = origin + col;
+    int low = pos >= width ? 0 : pos + len <= width ? len : width - pos;
+    memset(row + pos, c, low);
+    memset(row + pos + width, c, low);
+    if (len > low) {
+        memset(row + pos + low, c, len - low);
+        memset(row + pos + low - width, c, len - low);
+    }
+}
+
+// sets a single cell of a ring row
+static inline void ring_set(char* row, int origin, int width, int col, char c) {
+    int pos = origin + col < width ? origin + col : origin + col - width;
+    row[pos] = c;
+    row[pos + width] = c;
+}
+
+// counts the neighboring cells that differ in a run, from the pair at the
+// first column up to the pair at the last
+static inline int count_changes(const char* cells, int first, int last) {
+    int changes = 0;
+    for (int col = first; col < last; col++) {
+        changes += cells[col] != cells[col + 1];
+    }
+    return changes;
+}
+
+// copies the part of a world in view into the grid, the rows are compared
+// against the screen again on the next paint
+static void compose_view(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct chunk_t* chunk;
+    int row;
+    int col;
+    int len;
+    engine->board_origin = 0;
+    for (int r = 0; r < engine->view_height; r++) {
+        row = engine->view_row + r;
+        // a chunk at a time, unallocated ones are all board fill
+        for (int c = 0; c < engine->view_width; c += len) {
+            col = engine->view_col + c;
+            len = WORLD_CHUNK_SIZE - (col % WORLD_CHUNK_SIZE);
+            len = len < engine->view_width - c ? len : engine->view_width - c;
+            chunk = *chunk_at(engine, row, col);
+            if (chunk) {
+                ring_copy(engine->board[r], 0, engine->view_width, c,
+                        &chunk->cells[row % WORLD_CHUNK_SIZE][col % WORLD_CHUNK_SIZE], len);
+            }
+            else {
+                ring_fill(engine->board[r], 0, engine->view_width, c, data->clear_char, len);
+            }
+        }
+        engine->dirty[r] = 1;
+    }
+}
+
+// frees every chunk of a world, leaving it all board fill
+static void free_chunks(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    int count = engine->chunk_cols * ((data->height + WORLD_CHUNK_SIZE - 1) / WORLD_CHUNK_SIZE);
+    for (int i = 0; engine->chunk_count && i < count; i++) {
+        if (engine->chunks[i]) {
+            free(engine->chunks[i]);
+            engine->chunks[i] = NULL;
+            engine->chunk_count--;
+        }
+    }
+}
+
+// fills the game state grid with the clear character
+static inline void clear_board_grid(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    if (engine->chunks) {
+        free_chunks(data);
+        compose_view(data);
+        return;
+    }
+    engine->board_origin = 0;
+    for (int row = 0; row < data->height; row++) {
+        memset(engine->board[row], data->clear_char, 2 * data->width);
+        engine->dirty[row] = 1;
+    }
+}
+
+// marks the shown frame as blank after the screen was cleared so the next
+// paint resends every cell that is not a space
+static inline void invalidate_frame(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    for (int row = 0; row < engine->view_height; row++) {
+        memset(engine->shown[row], ' ', 2 * engine->view_width);
+        engine->shown_origin[row] = 0;
+        engine->shown_changes[row] = 0;
+        engine->dirty[row] = 1;
+    }
+    memset(engine->shifts, 0, sizeof(engine->shifts));
+    memset(engine->held_shifts, 0, sizeof(engine->held_shifts));
+    engine->scoreboard.valid = 0;
+    engine->hud.drawn = 0;
+}
+
+// returns if the whole board and scoreboard fit on the terminal
+static inline int board_fits(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    return Screen_Rows > CHAR_BOARD_HEIGHT(engine->view_height) &&
+        Screen_Cols >= engine->view_width + (2 * CHAR_BORDER_WIDTH);
+}
+
+// returns where a view along one axis of the board starts to keep a position
+// away from its edges, or to center it if asked to or if it jumped out of
+// view, without running off the board
+static inline int view_start(int start, int view, int board, int pos, int center) {
+    int margin = view * VIEW_MARGIN_PERCENT / 100;
+    if (center || pos < start || pos >= start + view) {
+        start = pos - (view / 2);
+    }
+    else if (pos < start + margin) {
+        start = pos - margin;
+    }
+    else if (pos >= start + view - margin) {
+        start = pos - view + margin + 1;
+    }
+    return start < 0 ? 0 : start > board - view ? board - view : start;
+}
+
+// sizes the view, the whole board or as much of a world as fits on the
+// terminal, centered on the same part of the world as before
+// note:
+//  - a world shows as much as the grid holds without a terminal and never
+//    less than the smallest board, smaller terminals are asked to resize
+static void set_view(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    int width = data->width;
+    int height = data->height;
+    int row = engine->view_row + (engine->view_height / 2);
+    int col = engine->view_col + (engine->view_width / 2);
+    if (engine->chunks) {
+        width = width < MAX_WIDTH ? width : MAX_WIDTH;
+        height = height < MAX_HEIGHT ? height : MAX_HEIGHT;
+        if (Screen_Rows && Screen_Cols) {
+            width = Screen_Cols - (2 * CHAR_BORDER_WIDTH) < width
+                ? Screen_Cols - (2 * CHAR_BORDER_WIDTH) : width;
+            height = Screen_Rows - CHAR_BOARD_HEIGHT(0) - 1 < height
+                ? Screen_Rows - CHAR_BOARD_HEIGHT(0) - 1 : height;
+        }
+        width = width > MIN_WIDTH ? width : MIN_WIDTH;
+        height = height > MIN_HEIGHT ? height : MIN_HEIGHT;
+    }
+    engine->view_width = width;
+    engine->view_height = height;
+    engine->view_row = view_start(0, height, data->height, row, 1);
+    engine->view_col = view_start(0, width, data->width, col, 1);
+    if (engine->chunks) {
+        compose_view(data);
+    }
+}
+
+// centers the board and scoreboard on the terminal, returns if they fit
+static int set_layout(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    engine->hidden = !board_fits(data);
+    if (engine->hidden) {
+        engine->top = 0;
+        engine->left = 0;
+        return 0;
+    }
+    engine->top = (Screen_Rows - CHAR_BOARD_HEIGHT(engine->view_height) - 1) / 2;
+    engine->left = (Screen_Cols - engine->view_width - (2 * CHAR_BORDER_WIDTH)) / 2;
+    return 1;
+}
+
+// clears the screen, sizes the view and lays the board out again for the
+// terminal and paints the title and borders, the board cells and scoreboard
+// are resent from the grid on the next paint
+static void paint_frame(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    char message[MAX_STRLEN];
+    int len;
     // clear the whole screen
-    clear();
+    (*engine->renderer->clear)();
+    set_view(data);
+    invalidate_frame(data);
+    // ask for a bigger terminal if the board does not fit
+    if (!set_layout(data)) {
+        len = sprintf(message, SMALL_SCREEN_FORMAT, engine->view_width + (2 * CHAR_BORDER_WIDTH),
+                CHAR_BOARD_HEIGHT(engine->view_height) + 1);
+        (*engine->renderer->text)(0, 0, message, len < Screen_Cols ? len : Screen_Cols);
+        return;
+    }
     // set the title
-    int col;
-    int line = set_title();
+    int line = set_title(data);
     // append the border below the title
-    line = append_horizontal_border(line);
-    // append the start/end vertical borders for each row and clear filler
-    for (int i = 0; i < Data->height; i++) {
-        col = 0;
-        mvaddch(line, col++, Data->vertical_char);
-        for (int j = 0; j < Data->width; j++) {
-            mvaddch(line, col++, Data->clear_char);
+    line = append_horizontal_border(data, line);
+    // append the start/end vertical borders for each row
+    for (int i = 0; i < engine->view_height; i++) {
+        layout_text(data, line, 0, &data->vertical_char, 1);
+        layout_text(data, line++, CHAR_BORDER_WIDTH + engine->view_width, &data->vertical_char, 1);
+    }
+    // append the border below the board
+    append_horizontal_border(data, line);
+}
+
+// initializes the board
+static void initialize_board(struct carcade_t* data) {
+    clear_board_grid(data);
+    paint_frame(data);
+}
+
+// terminal resize handler, the redraw happens on the next paint
+static void handle_resize(int sig) {
+    Flag_Resize = 1;
+}
+
+// redraws the whole screen from the grid if a resync was requested
+static inline void resync_screen(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct winsize size;
+    if (Flag_Resize) {
+        Flag_Resize = 0;
+        Flag_Redraw = 1;
+        // let the renderer know the new size without re-initializing it
+        if (!ioctl(Screen_Out.tty, TIOCGWINSZ, &size)) {
+            (*engine->renderer->resize)(size.ws_row, size.ws_col);
+        }
+    }
+    if (Flag_Redraw) {
+        Flag_Redraw = 0;
+        paint_frame(data);
+    }
+}
+
+// returns the nanoseconds from a to b
+static inline long long elapsed_ns(struct timespec* a, struct timespec* b) {
+    return (b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+// queues the given key for the game loop, dropped if the queue is full
+static inline void key_pressed(struct carcade_t* data, enum e_keystroke key, enum e_keystroke clear) {
+    struct engine_t* engine = data->engine;
+    unsigned int head = atomic_load_explicit(&engine->keys.head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&engine->keys.tail, memory_order_acquire) < KEY_QUEUE_SIZE) {
+        struct keystroke_t* slot = &engine->keys.keys[head & (KEY_QUEUE_SIZE - 1)];
+        slot->key = key;
+        slot->clear = clear;
+        clock_gettime(CLOCK_MONOTONIC, &slot->stamp);
+        atomic_store_explicit(&engine->keys.head, head + 1, memory_order_release);
+    }
+}
+
+// takes the oldest queued key, returns 0 if the queue is empty
+static inline int pop_key(struct carcade_t* data, struct keystroke_t* key) {
+    struct engine_t* engine = data->engine;
+    unsigned int tail = atomic_load_explicit(&engine->keys.tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&engine->keys.head, memory_order_acquire)) {
+        return 0;
+    }
+    *key = engine->keys.keys[tail & (KEY_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&engine->keys.tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// returns if more keys are queued
+static inline int keys_pending(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    return atomic_load_explicit(&engine->keys.tail, memory_order_relaxed) !=
+        atomic_load_explicit(&engine->keys.head, memory_order_acquire);
+}
+
+// returns if the character completes an arrow key escape sequence
+static inline int handle_arrow(struct carcade_t* data, char ch) {
+    switch (ch) {
+        case ARROW_UP_CHAR:
+            key_pressed(data, arrow_up, arrow_clear);
+            return 1;
+        case ARROW_DOWN_CHAR:
+            key_pressed(data, arrow_down, arrow_clear);
+            return 1;
+        case ARROW_RIGHT_CHAR:
+            key_pressed(data, arrow_right, arrow_clear);
+            return 1;
+        case ARROW_LEFT_CHAR:
+            key_pressed(data, arrow_left, arrow_clear);
+            return 1;
+    }
+    return 0;
+}
+
+// handles an ascii keystroke
+static inline void handle_ascii(struct carcade_t* data, char ch) {
+    struct engine_t* engine = data->engine;
+    switch (ch) {
+        case ASCII_UP_CHAR:
+            key_pressed(data, ascii_up, ascii_clear);
+            break;
+        case ASCII_DOWN_CHAR:
+            key_pressed(data, ascii_down, ascii_clear);
+            break;
+        case ASCII_RIGHT_CHAR:
+            key_pressed(data, ascii_right, ascii_clear);
+            break;
+        case ASCII_LEFT_CHAR:
+            key_pressed(data, ascii_left, ascii_clear);
+            break;
+        case CARCADE_REFRESH_CHAR:
+            Flag_Redraw = 1;
+            break;
+        case CARCADE_HUD_CHAR:
+            atomic_fetch_xor(&engine->show_hud, 1);
+            break;
+        case CARCADE_QUIT_CHAR:
+            engine->quit = 1;
+            break;
+    }
+}
+
+// feeds one character read from the keyboard through the arrow key escape
+// sequence parser, characters that break a sequence are handled as ascii
+static inline void handle_char(struct carcade_t* data, char ch) {
+    struct engine_t* engine = data->engine;
+    switch (engine->key_state) {
+        case key_state_escape:
+            if (ch == ARROW_IGNORE_CHAR) {
+                engine->key_state = key_state_arrow;
+                return;
+            }
+            break;
+        case key_state_arrow:
+            if (handle_arrow(data, ch)) {
+                engine->key_state = key_state_ascii;
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    engine->key_state = ch == ARROW_ESCAPE_CHAR ? key_state_escape : key_state_ascii;
+    if (engine->key_state == key_state_ascii) {
+        handle_ascii(data, ch);
+    }
+}
+
+// user input thread handler
+static void* get_keys(void* arg) {
+    struct carcade_t* data = arg;
+    struct engine_t* engine = data->engine;
+    int ch;
+    do {
+        // only try to read characters if running
+        if (engine->running) {
+            // timeout in case quit is set externally
+            if ((ch = (*engine->renderer->key)(GETCH_TIMEOUT_MS)) != ERR) {
+                handle_char(data, ch);
+            }
+        }
+    } while (!engine->kill_thread);
+    return NULL;
+}
+
+// handles every character already typed without waiting
+static inline void read_keys(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    int ch;
+    while ((ch = (*engine->renderer->key)(0)) != ERR) {
+        handle_char(data, ch);
+    }
+}
+
+// waits for the next event loop event, returns the ready descriptor or -1 if
+// interrupted by a signal
+static inline int wait_event(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct epoll_event event;
+    if (epoll_wait(engine->event_fd, &event, 1, -1) != 1) {
+        return -1;
+    }
+    return event.data.fd;
+}
+
+// presses this tick's key from the headless script or at random
+static inline void headless_key(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    static const enum e_keystroke keys[] = {
+        arrow_up, arrow_down, arrow_right, arrow_left,
+        ascii_up, ascii_down, ascii_right, ascii_left,
+    };
+    int i;
+    char ch;
+    if (engine->script) {
+        ch = engine->script[engine->script_pos];
+        engine->script_pos = (engine->script_pos + 1) % engine->script_len;
+        if (!handle_arrow(data, ch)) {
+            handle_ascii(data, ch);
+        }
+    }
+    else if (!(rand_r(&engine->input_seed) % RANDOM_KEY_ODDS)) {
+        i = rand_r(&engine->input_seed) % (sizeof(keys) / sizeof(*keys));
+        key_pressed(data, keys[i], i < 4 ? arrow_clear : ascii_clear);
+    }
+}
+
+// loads the headless keystroke script without whitespace, returns 0 on success
+static int load_script(struct carcade_t* data, const char* path) {
+    struct engine_t* engine = data->engine;
+    int ch;
+    long size = 0;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    while ((ch = fgetc(file)) != EOF) {
+        if (engine->script_len == size) {
+            size = size ? size * 2 : MAX_STRLEN;
+            engine->script = realloc(engine->script, size);
+        }
+        if (!isspace(ch)) {
+            engine->script[engine->script_len++] = ch;
+        }
+    }
+    fclose(file);
+    return engine->script_len ? 0 : -1;
+}
+
+// opens a recording and reads its header, returns null if it is not one
+static FILE* open_recording(const char* path, struct record_header_t* header) {
+    FILE* file = fopen(path, "rb");
+    if (file && (fread(header, sizeof(*header), 1, file) != 1 ||
+                memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) ||
+                header->version != RECORD_VERSION)) {
+        fclose(file);
+        file = NULL;
+    }
+    return file;
+}
+
+// fills in the recording header for the current data
+static void record_header(struct carcade_t* data, struct record_header_t* header, uint32_t argc) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, RECORD_MAGIC, sizeof(header->magic));
+    header->version = RECORD_VERSION;
+    header->seed = data->seed;
+    header->width = data->width;
+    header->height = data->height;
+    header->speed = data->speed;
+    header->keep_score = data->keep_score;
+    header->title_char = data->title_char;
+    header->corner_char = data->corner_char;
+    header->horizontal_char = data->horizontal_char;
+    header->vertical_char = data->vertical_char;
+    header->clear_char = data->clear_char;
+    header->argc = argc;
+}
+
+// returns how many arguments to leave out of the recording for one about how
+// the games are run rather than the board they are played on, 0 if recorded
+static inline int run_only_args(const char* arg) {
+    if (!strcmp(arg, EVENT_LOOP_ARG) || !strcmp(arg, HUD_ARG) || !strcmp(arg, HEADLESS_ARG) ||
+            !strcmp(arg, QUIET_ARG)) {
+        return 1;
+    }
+    if (!strcmp(arg, RECORD_ARG) || !strcmp(arg, REPLAY_ARG) || !strcmp(arg, SEED_ARG) ||
+            !strcmp(arg, GAMES_ARG) || !strcmp(arg, TICKS_ARG) || !strcmp(arg, SCRIPT_ARG) ||
+            !strcmp(arg, RENDER_ARG) || !strcmp(arg, SPECTATE_ARG)) {
+        return 2;
+    }
+    return 0;
+}
+
+// starts the recording with the header and the arguments that set up the game,
+// returns 0 on success
+static int start_record(struct carcade_t* data, int argc, char** argv) {
+    struct engine_t* engine = data->engine;
+    struct record_header_t header;
+    uint32_t count = 0;
+    uint16_t len;
+    engine->record_file = fopen(data->record, "wb");
+    if (!engine->record_file) {
+        return -1;
+    }
+    engine->record_run = 0;
+    // the seed is in the header and the way the games are run is up to the replay
+    for (int i = 1; i < argc; i++) {
+        if (run_only_args(argv[i])) {
+            i += run_only_args(argv[i]) - 1;
+        }
+        else {
+            count++;
+        }
+    }
+    record_header(data, &header, count);
+    fwrite(&header, sizeof(header), 1, engine->record_file);
+    for (int i = 1; i < argc; i++) {
+        if (run_only_args(argv[i])) {
+            i += run_only_args(argv[i]) - 1;
+            continue;
+        }
+        len = strlen(argv[i]);
+        fwrite(&len, sizeof(len), 1, engine->record_file);
+        fwrite(argv[i], 1, len, engine->record_file);
+    }
+    return ferror(engine->record_file) ? -1 : 0;
+}
+
+// writes out the keystroke mask waiting to be recorded
+static inline void record_flush(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    uint16_t rec;
+    if (engine->record_run) {
+        rec = ((engine->record_run - 1) << RECORD_MASK_BITS) | engine->record_mask;
+        fwrite(&rec, sizeof(rec), 1, engine->record_file);
+        engine->record_run = 0;
+    }
+}
+
+// records the keystroke mask handed to a move, repeats are run length encoded
+static inline void record_key(struct carcade_t* data, enum e_keystroke key) {
+    struct engine_t* engine = data->engine;
+    if (engine->record_run && (key != engine->record_mask || engine->record_run == RECORD_MAX_RUN)) {
+        record_flush(data);
+    }
+    engine->record_mask = key;
+    engine->record_run++;
+}
+
+// records the end of a game
+static inline void record_game_end(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    uint16_t rec = RECORD_GAME_END;
+    record_flush(data);
+    fwrite(&rec, sizeof(rec), 1, engine->record_file);
+}
+
+// returns the next replayed keystroke mask, a quit once the recorded game ended
+static inline enum e_keystroke replay_key(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    uint16_t rec;
+    if (!engine->replay_run) {
+        if (fread(&rec, sizeof(rec), 1, engine->replay_file) != 1 || rec == RECORD_GAME_END) {
+            // leave the end of the game for game_over to find
+            if (!feof(engine->replay_file)) {
+                fseek(engine->replay_file, -(long)sizeof(rec), SEEK_CUR);
+            }
+            return carcade_quit;
+        }
+        engine->replay_mask = rec & ((1 << RECORD_MASK_BITS) - 1);
+        engine->replay_run = (rec >> RECORD_MASK_BITS) + 1;
+    }
+    engine->replay_run--;
+    return engine->replay_mask;
+}
+
+// skips to the end of the replayed game, returns if another game follows
+static inline int replay_game_end(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    uint16_t rec;
+    int rest = engine->replay_run != 0;
+    engine->replay_run = 0;
+    while (fread(&rec, sizeof(rec), 1, engine->replay_file) == 1 && rec != RECORD_GAME_END) {
+        rest = 1;
+    }
+    // keystrokes left over mean the game ended before it did when recorded
+    if (rest) {
+        engine->replay_diverged++;
+    }
+    if (fread(&rec, sizeof(rec), 1, engine->replay_file) != 1) {
+        return 0;
+    }
+    fseek(engine->replay_file, -(long)sizeof(rec), SEEK_CUR);
+    return 1;
+}
+
+// applies the queued keys to engine->next according to the key policy, returns the
+// next keystroke(s)
+static inline enum e_keystroke next_key(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct keystroke_t key;
+    struct timespec now;
+    long long max_age;
+    if (engine->quit || engine->kill_thread) {
+        return carcade_quit;
+    }
+    // a replay hands over exactly what was recorded, the key policy has
+    // already been applied
+    if (engine->replay_file) {
+        return replay_key(data);
+    }
+    if (data->headless) {
+        headless_key(data);
+        if (engine->quit) {
+            return carcade_quit;
         }
-        mvaddch(line++, col, Data->vertical_char);
     }
-    // append the border below the board
-    append_horizontal_border(line);
+    switch (data->key_policy) {
+        case key_policy_turn:
+            // take the first queued key that changes the direction, skipping
+            // stale keys if newer ones are waiting behind them
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            max_age = KEY_MAX_AGE_TICKS * TICK_NSEC(data->speed);
+            while (pop_key(data, &key)) {
+                if (key.key != engine->next &&
+                        (elapsed_ns(&key.stamp, &now) <= max_age || !keys_pending(data))) {
+                    engine->next = key.key;
+                    break;
+                }
+            }
+            break;
+        case key_policy_or:
+            while (pop_key(data, &key)) {
+                engine->next = data->single_key ? (engine->next & key.clear) | key.key : engine->next | key.key;
+            }
+            break;
+        default:
+            while (pop_key(data, &key)) {
+                engine->next = key.key;
+            }
+            break;
+    }
+    return engine->next;
+}
+
+// clears the active gameboard, the cleared cells are sent on the next paint
+static inline void clear_board_contents(struct carcade_t* data) {
+    clear_board_grid(data);
+}
+
+// sends the cells of a row that differ from the shown frame
+// note:
+//  - changed cells separated by a short run of unchanged cells are sent as one
+//    span, rewriting a few cells is cheaper than another cursor move
+static inline void paint_dirty_row(struct carcade_t* data, int row) {
+    struct engine_t* engine = data->engine;
+    int start;
+    int end;
+    int first;
+    int last;
+    int col = 0;
+    char* cur = engine->board[row] + engine->board_origin;
+    char* prev = engine->shown[row] + engine->shown_origin[row];
+    while (col < engine->view_width) {
+        // skip to the first changed cell
+        while (col < engine->view_width && cur[col] == prev[col]) {
+            col++;
+        }
+        if (col == engine->view_width) {
+            break;
+        }
+        // extend the span until the unchanged run gets too long
+        start = col;
+        end = ++col;
+        while (col < engine->view_width && col - end < SPAN_MERGE_GAP) {
+            if (cur[col] != prev[col]) {
+                end = col + 1;
+            }
+            col++;
+        }
+        col = end;
+        // a failed write on a screen big enough for the board means curses
+        // and the shown frame disagree, resync on the next paint
+        if (layout_text(data, CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT + row,
+                    CHAR_BORDER_WIDTH + start, cur + start, end - start)) {
+            Flag_Redraw = 1;
+        }
+        // recount the neighboring cells around the span as they are now
+        first = start > 0 ? start - 1 : 0;
+        last = end < engine->view_width ? end : engine->view_width - 1;
+        engine->shown_changes[row] -= count_changes(prev, first, last);
+        ring_copy(engine->shown[row], engine->shown_origin[row], engine->view_width, start,
+                cur + start, end - start);
+        engine->shown_changes[row] += count_changes(prev, first, last);
+    }
+    engine->dirty[row] = 0;
+}
+
+// fills in the scoreboard line, returns its length
+static int format_scoreboard(struct carcade_t* data, char* line) {
+    struct engine_t* engine = data->engine;
+    char* buf;
+    char right[MAX_STRLEN];
+    int left_len;
+    int right_len;
+    int filler;
+    // fill in the scoreboard labels
+    if (data->keep_score) {
+        sprintf(line, SCOREBOARD_SCORE, data->score);
+    }
+    else {
+        *line = '\0';
+    }
+    sprintf(right, SCOREBOARD_WIDTH_HEIGHT_SPEED, data->width, data->height, data->speed);
+    left_len = strlen(line);
+    right_len = strlen(right);
+    // append the right label to the left separated by as many spaces as
+    // possible to give the appearance of aligned text
+    buf = line + left_len;
+    filler = engine->view_width + (2 * CHAR_BORDER_WIDTH) - left_len - right_len;
+    for (int i = 0; i < filler; i++) {
+        *(buf++) = ' ';
+    }
+    // copy over the right label
+    memcpy(buf, right, right_len);
+    buf += right_len;
+    return buf - line;
+}
+
+// updates the scoreboard if any of its values changed since the last paint
+static inline void paint_scoreboard(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    char line[MAX_STRLEN];
+    if (engine->scoreboard.valid &&
+            engine->scoreboard.keep_score == data->keep_score &&
+            engine->scoreboard.score == data->score &&
+            engine->scoreboard.width == data->width &&
+            engine->scoreboard.height == data->height &&
+            engine->scoreboard.speed == data->speed) {
+        return;
+    }
+    engine->scoreboard.valid = 1;
+    engine->scoreboard.keep_score = data->keep_score;
+    engine->scoreboard.score = data->score;
+    engine->scoreboard.width = data->width;
+    engine->scoreboard.height = data->height;
+    engine->scoreboard.speed = data->speed;
+    // update the scoreboard
+    layout_text(data, CHAR_BOARD_HEIGHT(engine->view_height), 0, line, format_scoreboard(data, line));
+}
+
+// returns the current monotonic time in nanoseconds
+static inline long long now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// compares two samples for sorting
+static int compare_samples(const void* a, const void* b) {
+    long long diff = *(const long long*)a - *(const long long*)b;
+    return diff < 0 ? -1 : diff > 0;
+}
+
+// formats the p50/p99/max microseconds of a sample window into buf
+static inline void format_samples(char* buf, const char* format, long long* window, int n) {
+    long long sorted[HUD_WINDOW];
+    memcpy(sorted, window, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), compare_samples);
+    sprintf(buf, format, sorted[n / 2] / 1000, sorted[(n * 99) / 100] / 1000,
+            sorted[n - 1] / 1000);
+}
+
+// paints the performance overlay below the scoreboard every few ticks or
+// erases it once it has been hidden
+static inline void paint_hud(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    char lines[HUD_LINES][MAX_STRLEN];
+    int n = engine->hud.count < HUD_WINDOW ? engine->hud.count : HUD_WINDOW;
+    int len = engine->view_width + (2 * CHAR_BORDER_WIDTH);
+    int line_len;
+    int newest = (engine->hud.count - 1) % HUD_WINDOW;
+    int oldest = (engine->hud.count - n) % HUD_WINDOW;
+    long long span;
+    if (engine->hud.shown) {
+        // counted in ticks rather than painted frames, some may be dropped
+        if (engine->hud.drawn && engine->hud.count - engine->hud.updated < HUD_UPDATE_TICKS) {
+            return;
+        }
+        memset(lines, '\0', sizeof(lines));
+        if (n > 1) {
+            span = engine->hud.start[newest] - engine->hud.start[oldest];
+            sprintf(lines[0], HUD_TICKS_FORMAT, span > 0 ? (n - 1) * 1e9 / span : 0);
+            sprintf(lines[1], HUD_DROPPED_FORMAT, engine->dropped);
+            sprintf(lines[2], HUD_HEADER);
+            format_samples(lines[3], HUD_MOVE_FORMAT, engine->hud.move, n);
+            format_samples(lines[4], HUD_PAINT_FORMAT, engine->hud.paint, n);
+            format_samples(lines[5], HUD_LATE_FORMAT, engine->hud.late, n);
+        }
+        engine->hud.drawn = 1;
+        engine->hud.updated = engine->hud.count;
+    }
+    else if (engine->hud.drawn) {
+        memset(lines, '\0', sizeof(lines));
+        engine->hud.drawn = 0;
+    }
+    else {
+        return;
+    }
+    // pad each line so it overwrites the last one and cut a longer one to the
+    // board, lines past the bottom of the screen are left out
+    for (int i = 0; i < HUD_LINES; i++) {
+        line_len = strlen(lines[i]);
+        if (line_len < len) {
+            memset(lines[i] + line_len, ' ', len - line_len);
+        }
+        if (engine->top + CHAR_BOARD_HEIGHT(engine->view_height) + 1 + i < Screen_Rows) {
+            layout_text(data, CHAR_BOARD_HEIGHT(engine->view_height) + 1 + i, 0, lines[i], len);
+        }
+    }
+}
+
+// appends bytes to the frame being encoded for the spectators
+static inline void spectate_append(struct spectate_t* spectate, const char* str, int len) {
+    if (spectate->len + len > spectate->size) {
+        spectate->size = (spectate->len + len) * 2;
+        spectate->buf = realloc(spectate->buf, spectate->size);
+    }
+    memcpy(spectate->buf + spectate->len, str, len);
+    spectate->len += len;
+}
+
+// appends a cursor move and the text at the screen row/col to the frame
+static inline void spectate_text(struct spectate_t* spectate, int row, int col, const char* str, int len) {
+    char seq[MAX_STRLEN];
+    spectate_append(spectate, seq, sprintf(seq, ANSI_MOVE_FORMAT, row + 1, col + 1));
+    spectate_append(spectate, str, len);
+}
+
+// takes the encoded bytes as a frame for the spectators, null if none
+static struct frame_t* spectate_frame(struct spectate_t* spectate) {
+    struct frame_t* frame = NULL;
+    if (spectate->len) {
+        spectate_append(spectate, ANSI_SYNC_END, sizeof(ANSI_SYNC_END) - 1);
+        frame = malloc(sizeof(*frame) + spectate->len);
+    }
+    if (frame) {
+        frame->refs = 1;
+        frame->len = spectate->len;
+        memcpy(frame->buf, spectate->buf, spectate->len);
+    }
+    spectate->len = 0;
+    return frame;
+}
+
+// lets go of a frame, freeing it once nobody holds it
+static inline void release_frame(struct frame_t* frame) {
+    if (frame && !--frame->refs) {
+        free(frame);
+    }
+}
+
+// encodes the whole screen as spectators see it
+static struct frame_t* encode_keyframe(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct spectate_t* spectate = &engine->spectate;
+    char line[MAX_WIDTH + (2 * CHAR_BORDER_WIDTH)];
+    int len = engine->view_width + (2 * CHAR_BORDER_WIDTH);
+    int row = CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT;
+    spectate_append(spectate, ANSI_SYNC_BEGIN ANSI_CLEAR, sizeof(ANSI_SYNC_BEGIN ANSI_CLEAR) - 1);
+    spectate_text(spectate, 0, 0, line, format_title(data, line));
+    spectate_text(spectate, CHAR_TITLE_HEIGHT, 0, line, format_horizontal_border(data, line));
+    line[0] = data->vertical_char;
+    line[len - 1] = data->vertical_char;
+    for (int i = 0; i < engine->view_height; i++) {
+        memcpy(line + CHAR_BORDER_WIDTH, spectate->published[i], engine->view_width);
+        spectate_text(spectate, row++, 0, line, len);
+    }
+    spectate_text(spectate, row, 0, line, format_horizontal_border(data, line));
+    spectate_text(spectate, CHAR_BOARD_HEIGHT(engine->view_height), 0, spectate->scoreboard,
+            spectate->scoreboard_len);
+    return spectate_frame(spectate);
+}
+
+// brings the published board and scoreboard up to date, encoding the cells
+// that changed as a frame if anyone is watching
+// note:
+//  - rows the board scrolled are scrolled for the spectators the same way the
+//    screen is, before the cells are compared
+static struct frame_t* encode_delta(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct spectate_t* spectate = &engine->spectate;
+    char line[MAX_STRLEN];
+    char seq[MAX_STRLEN];
+    int screen_row;
+    int start;
+    int end;
+    int col;
+    int len;
+    char* cur;
+    char* prev;
+    spectate_append(spectate, ANSI_SYNC_BEGIN, sizeof(ANSI_SYNC_BEGIN) - 1);
+    for (int row = 0; row < engine->view_height; row++) {
+        if (!engine->dirty[row]) {
+            continue;
+        }
+        screen_row = CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT + row;
+        cur = engine->board[row] + engine->board_origin;
+        prev = spectate->published[row];
+        for (int i = 0; i < engine->shifts[row]; i++) {
+            spectate_append(spectate, seq, sprintf(seq, ANSI_MOVE_FORMAT, screen_row + 1,
+                        CHAR_BORDER_WIDTH + 1));
+            spectate_append(spectate, ANSI_DELETE_CHAR, sizeof(ANSI_DELETE_CHAR) - 1);
+            spectate_append(spectate, seq, sprintf(seq, ANSI_MOVE_FORMAT, screen_row + 1,
+                        CHAR_BORDER_WIDTH + engine->view_width));
+            spectate_append(spectate, ANSI_INSERT_CHAR, sizeof(ANSI_INSERT_CHAR) - 1);
+            memmove(prev, prev + 1, engine->view_width - 1);
+            prev[engine->view_width - 1] = ' ';
+        }
+        // the same spans the screen is sent
+        for (col = 0; col < engine->view_width; ) {
+            for (; col < engine->view_width && cur[col] == prev[col]; col++);
+            if (col == engine->view_width) {
+                break;
+            }
+            start = col;
+            end = ++col;
+            for (; col < engine->view_width && col - end < SPAN_MERGE_GAP; col++) {
+                if (cur[col] != prev[col]) {
+                    end = col + 1;
+                }
+            }
+            col = end;
+            spectate_text(spectate, screen_row, CHAR_BORDER_WIDTH + start, cur + start, end - start);
+            memcpy(prev + start, cur + start, end - start);
+        }
+    }
+    len = format_scoreboard(data, line);
+    if (len != spectate->scoreboard_len || memcmp(line, spectate->scoreboard, len)) {
+        memcpy(spectate->scoreboard, line, len);
+        spectate->scoreboard_len = len;
+        spectate_text(spectate, CHAR_BOARD_HEIGHT(engine->view_height), 0, line, len);
+    }
+    // nothing changed or nobody to send it to
+    if (spectate->len == sizeof(ANSI_SYNC_BEGIN) - 1 || !spectate->count) {
+        spectate->len = 0;
+    }
+    return spectate_frame(spectate);
+}
+
+// sends a spectator as much of its queued frames as it takes without
+// blocking, returns -1 if it has gone
+static int send_frames(struct spectator_t* viewer) {
+    struct frame_t* frame;
+    ssize_t ret;
+    while (viewer->head != viewer->tail) {
+        frame = viewer->frames[viewer->head % SPECTATE_QUEUE];
+        ret = send(viewer->fd, frame->buf + viewer->sent, frame->len - viewer->sent,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        viewer->sent += ret;
+        if (viewer->sent == frame->len) {
+            release_frame(frame);
+            viewer->head++;
+            viewer->sent = 0;
+        }
+    }
+    return 0;
+}
+
+// drops the frames queued for a spectator, all but one it is partway through
+static void drop_frames(struct spectator_t* viewer) {
+    unsigned int keep = viewer->head + (viewer->sent > 0);
+    for (unsigned int i = keep; i != viewer->tail; i++) {
+        release_frame(viewer->frames[i % SPECTATE_QUEUE]);
+    }
+    viewer->tail = keep;
+}
+
+// queues a frame for a spectator
+static inline void queue_frame(struct spectator_t* viewer, struct frame_t* frame) {
+    frame->refs++;
+    viewer->frames[viewer->tail++ % SPECTATE_QUEUE] = frame;
+}
+
+// closes a spectator, the last one takes its place
+static void close_spectator(struct spectate_t* spectate, int i) {
+    struct spectator_t* viewer = &spectate->viewers[i];
+    viewer->sent = 0;
+    drop_frames(viewer);
+    close(viewer->fd);
+    *viewer = spectate->viewers[--spectate->count];
+}
+
+// publishes the frame to the spectators
+static void publish_frame(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct spectate_t* spectate = &engine->spectate;
+    struct spectator_t* viewer;
+    struct frame_t* delta;
+    struct frame_t* keyframe = NULL;
+    int fd;
+    // take in anyone new, they start with a keyframe
+    while ((fd = accept(spectate->fd, NULL, NULL)) >= 0) {
+        if (spectate->count == SPECTATE_MAX) {
+            close(fd);
+            continue;
+        }
+        viewer = &spectate->viewers[spectate->count++];
+        memset(viewer, 0, sizeof(*viewer));
+        viewer->fd = fd;
+        viewer->behind = 1;
+    }
+    delta = encode_delta(data);
+    // a view of a world sized again for the terminal is laid out again for
+    // everyone
+    if (spectate->width != engine->view_width || spectate->height != engine->view_height) {
+        spectate->width = engine->view_width;
+        spectate->height = engine->view_height;
+        for (int i = 0; i < spectate->count; i++) {
+            spectate->viewers[i].behind = 1;
+        }
+    }
+    for (int i = 0; i < spectate->count; i++) {
+        viewer = &spectate->viewers[i];
+        if (delta && viewer->tail - viewer->head == SPECTATE_QUEUE) {
+            viewer->behind = 1;
+        }
+        if (viewer->behind) {
+            if (!keyframe) {
+                keyframe = encode_keyframe(data);
+            }
+            drop_frames(viewer);
+            if (keyframe && viewer->tail - viewer->head < SPECTATE_QUEUE) {
+                queue_frame(viewer, keyframe);
+                viewer->behind = 0;
+            }
+        }
+        else if (delta) {
+            queue_frame(viewer, delta);
+        }
+    }
+    release_frame(delta);
+    release_frame(keyframe);
+    for (int i = spectate->count - 1; i >= 0; i--) {
+        if (send_frames(&spectate->viewers[i])) {
+            close_spectator(spectate, i);
+        }
+    }
+}
+
+// starts listening for spectators on the unix socket, returns 0 on success
+static int start_spectate(struct carcade_t* data) {
+    struct spectate_t* spectate = &data->engine->spectate;
+    struct sockaddr_un addr;
+    struct stat info;
+    if (strlen(data->spectate) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, data->spectate);
+    // a socket left behind by an earlier game is replaced, nothing else is
+    if (!stat(data->spectate, &info) && S_ISSOCK(info.st_mode)) {
+        unlink(data->spectate);
+    }
+    spectate->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (spectate->fd < 0) {
+        return -1;
+    }
+    if (bind(spectate->fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(spectate->fd);
+        spectate->fd = -1;
+        return -1;
+    }
+    if (listen(spectate->fd, SPECTATE_MAX)) {
+        close(spectate->fd);
+        unlink(data->spectate);
+        spectate->fd = -1;
+        return -1;
+    }
+    // the board starts out blank for everyone
+    memset(spectate->published, ' ', sizeof(spectate->published));
+    return 0;
 }
 
-// updates Next for the given key
-static inline void key_pressed(enum e_keystroke key, enum e_keystroke clear) {
-    if (Data->ORkeys) {
-        if (Data->single_key) {
-            Next = (Next & clear) | key;
-        }
-        else {
-            Next |= key;
-        }
+// closes the spectators and stops listening for them
+static void stop_spectate(struct carcade_t* data) {
+    struct spectate_t* spectate = &data->engine->spectate;
+    if (spectate->fd < 0) {
+        return;
     }
-    else {
-        Next = key;
+    while (spectate->count) {
+        close_spectator(spectate, spectate->count - 1);
     }
+    close(spectate->fd);
+    unlink(data->spectate);
+    free(spectate->buf);
+    spectate->fd = -1;
 }
 
-// returns if an arrow key was processed
-static inline int handle_arrow(char* ch) {
-    if ((*ch = getch()) == ARROW_ESCAPE_CHAR) {
-        if ((*ch = getch()) == ARROW_IGNORE_CHAR) {
-            switch ((*ch = getch())) {
-                case ARROW_UP_CHAR:
-                    key_pressed(arrow_up, arrow_clear);
-                    return 1;
-                case ARROW_DOWN_CHAR:
-                    key_pressed(arrow_down, arrow_clear);
-                    return 1;
-                case ARROW_RIGHT_CHAR:
-                    key_pressed(arrow_right, arrow_clear);
-                    return 1;
-                case ARROW_LEFT_CHAR:
-                    key_pressed(arrow_left, arrow_clear);
-                    return 1;
-            }
+// paints the current contents of the board to the console
+static inline void paint_current_board(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    long long written;
+    if (engine->spectate.fd >= 0) {
+        publish_frame(data);
+    }
+    // without a screen the game only lives in the grid, what changed has been
+    // published and is not looked at again
+    if (engine->renderer == &None_Renderer) {
+        memset(engine->shifts, 0, sizeof(engine->shifts));
+        memset(engine->dirty, 0, engine->view_height);
+        return;
+    }
+    written = screen_written();
+    resync_screen(data);
+    // nothing is shown until the terminal is big enough again
+    if (engine->hidden) {
+        memset(engine->shifts, 0, sizeof(engine->shifts));
+        memset(engine->held_shifts, 0, sizeof(engine->held_shifts));
+        if ((*engine->renderer->flush)()) {
+            Flag_Redraw = 1;
         }
+        return;
     }
-    return 0;
-}
-
-// handles an ascii keystroke
-static inline void handle_ascii(char ch) {
-    switch (ch) {
-        case ASCII_UP_CHAR:
-            key_pressed(ascii_up, ascii_clear);
-            break;
-        case ASCII_DOWN_CHAR:
-            key_pressed(ascii_down, ascii_clear);
-            break;
-        case ASCII_RIGHT_CHAR:
-            key_pressed(ascii_right, ascii_clear);
-            break;
-        case ASCII_LEFT_CHAR:
-            key_pressed(ascii_left, ascii_clear);
-            break;
-        case CARCADE_REFRESH_CHAR:
-            Flag_Paint_Count = Data->speed;
-            break;
-        case CARCADE_QUIT_CHAR:
-            Flag_Quit = 1;
-            break;
+    // scroll the screen the way the board was scrolled, including during the
+    // frames dropped before this one
+    for (int row = 0; row < engine->view_height; row++) {
+        engine->shifts[row] += engine->held_shifts[row];
+        engine->held_shifts[row] = 0;
+        for (; engine->shifts[row] > 0; engine->shifts[row]--) {
+            (*engine->renderer->shift)(engine->top + CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT + row,
+                    engine->left + CHAR_BORDER_WIDTH, engine->view_width);
+        }
+    }
+    // push only the cells that changed since the last frame
+    for (int row = 0; row < engine->view_height; row++) {
+        if (engine->dirty[row]) {
+            paint_dirty_row(data, row);
+        }
+    }
+    paint_scoreboard(data);
+    paint_hud(data);
+    // show the frame
+    if ((*engine->renderer->flush)()) {
+        Flag_Redraw = 1;
     }
+    engine->frame_bytes = screen_written() - written;
 }
 
-// user input thread handler
-static void* get_keys(void* arg) {
-    char ch;
-    do {
-        // only try to read characters if running
-        if (Flag_Running) {
-            // timeout in case Flag_Quit is set externally
-            halfdelay(GETCH_TIMEOUT);
-            if (!handle_arrow(&ch)) {
-                handle_ascii(ch);
-            }
-        }
-    } while (!Flag_Kill_Thread);
-    // set the quit, bypass OR logic
-    Next = carcade_quit;
-    return NULL;
+// drops this tick's frame while the terminal is more than a frame behind,
+// returns 1 if it was dropped
+// note:
+//  - a frame the size of the last one shown is let through, so a terminal
+//    still taking it in does not lose the next one
+//  - the grid keeps every change so the next frame shown catches up on all of
+//    them, the spectators are still sent every frame
+static inline int drop_frame(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    if (engine->renderer == &None_Renderer || engine->hidden ||
+            screen_backlog() <= engine->frame_bytes) {
+        return 0;
+    }
+    if (engine->spectate.fd >= 0) {
+        publish_frame(data);
+    }
+    for (int row = 0; row < engine->view_height; row++) {
+        engine->held_shifts[row] += engine->shifts[row];
+        engine->shifts[row] = 0;
+    }
+    engine->dropped++;
+    return 1;
 }
 
-// returns the next keystroke(s)
-static inline enum e_keystroke next_key(void) {
-    return Flag_Quit || Flag_Kill_Thread ? carcade_quit : Next;
+// starts the tick schedule from the current time
+static inline void reset_tick(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    clock_gettime(CLOCK_MONOTONIC, &engine->next_tick);
 }
 
-// clears the active gameboard
-static inline void clear_board_contents(void) {
-    // skip over initial characters
-    int first_line = CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT;
-    // go through each row filling in the designated clear chars
-    for (int row = 0; row < Data->height; row++) {
-        for (int col = 0; col < Data->width; col++) {
-            mvaddch(first_line + row, CHAR_BORDER_WIDTH + col, Data->clear_char);
+// arms the tick timer for the deadline and handles keys as they arrive until
+// it expires
+static inline void wait_tick_event(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    uint64_t expired;
+    struct itimerspec deadline;
+    memset(&deadline, 0, sizeof(deadline));
+    deadline.it_value = engine->next_tick;
+    timerfd_settime(engine->timer_fd, TFD_TIMER_ABSTIME, &deadline, NULL);
+    while (!engine->quit) {
+        switch (wait_event(data)) {
+            case STDIN_FILENO:
+                read_keys(data);
+                break;
+            case -1:
+                break;
+            default:
+                read(engine->timer_fd, &expired, sizeof(expired));
+                return;
         }
     }
 }
 
-// paints the current contents of the board to the console
-static inline void paint_current_board(void) {
-    char* buf;
-    char left[MAX_STRLEN];
-    char right[MAX_STRLEN];
-    int left_len;
-    int right_len;
-    int filler;
-    // fill in the scoreboard labels
-    if (Data->keep_score) {
-        sprintf(left, SCOREBOARD_SCORE, Data->score);
+// advances the tick deadline by one period and sleeps until it
+// note:
+//  - the deadline is absolute so time spent moving and rendering is already
+//    accounted for and the tick rate does not drift
+//  - a late tick runs the next one immediately, once more than
+//    MAX_CATCHUP_TICKS behind the schedule restarts from now instead
+static inline void wait_tick(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    struct timespec now;
+    long long period = TICK_NSEC(data->speed);
+    // headless games are never throttled
+    if (data->headless) {
+        return;
     }
-    else {
-        *left = '\0';
+    engine->next_tick.tv_nsec += period % 1000000000LL;
+    engine->next_tick.tv_sec += period / 1000000000LL + engine->next_tick.tv_nsec / 1000000000L;
+    engine->next_tick.tv_nsec %= 1000000000L;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (elapsed_ns(&engine->next_tick, &now) > MAX_CATCHUP_TICKS * period) {
+        engine->next_tick = now;
+        return;
     }
-    sprintf(right, SCOREBOARD_WIDTH_HEIGHT_SPEED, Data->width, Data->height, Data->speed);
-    left_len = strlen(left);
-    right_len = strlen(right);
-    // append the right label to the left separated by as many spaces as
-    // possible to give the appearance of aligned text
-    buf = left + left_len;
-    for (int i = 0; i < Data->width + (2 * CHAR_BORDER_WIDTH) - left_len - right_len; i++) {
-        *(buf++) = ' ';
+    if (data->event_loop) {
+        wait_tick_event(data);
     }
-    // copy over the right label, add newline and null terminate
-    memcpy(buf, right, right_len);
-    buf += right_len;
-    *(buf++) = '\n';
-    *buf = '\0';
-    // update the scoreboard
-    mvaddstr(CHAR_BOARD_HEIGHT(Data->height), 0, left);
-    // refresh curses window
-    refresh();
-    doupdate();
-    if (Flag_Paint_Count++ >= Data->speed) {
-        endwin();
-        initscr();
-        refresh();
-        doupdate();
-        Flag_Paint_Count = 0;
+    else {
+        // interrupted by a signal, keep waiting for the same deadline
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &engine->next_tick, NULL) == EINTR &&
+                !engine->quit && !engine->kill_thread);
+    }
+    // record how late the wakeup was for the overlay
+    if (engine->hud.shown && engine->hud.count) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        engine->hud.late[(engine->hud.count - 1) % HUD_WINDOW] = elapsed_ns(&engine->next_tick, &now);
     }
 }
 
 // gets the first character and clears the input buffer if many keys are clicked
-static inline char user_input(void) {
-    // wait for any user input
-    cbreak();
-    char ch = getch();
+static inline char user_input(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    int ch;
+    if (data->headless) {
+        return '\0';
+    }
+    if (data->event_loop) {
+        // block in epoll until a key arrives, redraw if resized meanwhile
+        while ((ch = (*engine->renderer->key)(0)) == ERR) {
+            if (wait_event(data) < 0 && Flag_Resize) {
+                paint_current_board(data);
+            }
+        }
+        // clear the buffer
+        while ((*engine->renderer->key)(0) != ERR);
+        return ch;
+    }
+    // wait for any user input, redraw if resized meanwhile
+    while ((ch = (*engine->renderer->key)(GETCH_TIMEOUT_MS)) == ERR) {
+        if (Flag_Resize) {
+            paint_current_board(data);
+        }
+    }
     // clear the buffer
-    do {
-        halfdelay(GETCH_TIMEOUT);
-    } while (getch() != ERR);
+    while ((*engine->renderer->key)(GETCH_TIMEOUT_MS) != ERR);
     return ch;
 }
 
@@ -261,15 +2022,31 @@ void print_carcade_help(void) {
     printf("\t"
             WIDTH_ARG         "\t\tint  - the game width between %d and %d\n\t"
             HEIGHT_ARG        "\t\tint  - the game height between %d and %d\n\t"
+                              "\t\t       snake and tron play worlds up to %dx%d, the view\n\t"
+                              "\t\t       of them follows the player\n\t"
             SPEED_ARG         "\t\tint  - the game speed between %d and %d\n\t"
             KEEP_SCORE_ARG      "\t     - disable score keeping\n\t"
+            EVENT_LOOP_ARG      "\t\t     - wait on input and ticks with epoll, no input thread\n\t"
+            RENDER_ARG        "\t\tname - the screen backend: " RENDER_CURSES_NAME ", "
+                                RENDER_ANSI_NAME " or " RENDER_NONE_NAME " (headless only)\n\t"
+            HUD_ARG             "\t\t     - show the performance overlay, toggled with '%c'\n\t"
+            HEADLESS_ARG        "\t     - run without a terminal as fast as possible\n\t"
+            SEED_ARG          "\t\tint  - the random seed, 0 for time based\n\t"
+            GAMES_ARG         "\t\tint  - the number of headless games\n\t"
+            TICKS_ARG         "\t\tint  - the tick limit of each headless game\n\t"
+            SCRIPT_ARG        "\t\tfile - headless keys, one per tick: w/a/s/d, arrows A/B/C/D,\n\t"
+                              "\t\t       q quits, anything else is idle, random if unset\n\t"
+            QUIET_ARG         "\t\t     - do not report headless games\n\t"
+            RECORD_ARG        "\t\tfile - record the seed, board and keystrokes of every game\n\t"
+            REPLAY_ARG        "\t\tfile - play back a recording, unthrottled if headless\n\t"
+            SPECTATE_ARG        "\tpath - publish the game on a unix socket, watch with nc -U\n\t"
             TITLE_CHAR_ARG    "\t\tchar - the title style\n\t"
             CORNER_CHAR_ARG   "\t\tchar - the corner style\n\t"
             HORIZONTAL_CHAR_ARG "\tchar - the horizontal border style\n\t"
             VERTICAL_CHAR_ARG   "\tchar - the vertical border style\n\t"
             CLEAR_CHAR_ARG    "\t\tchar - the board fill style\n\n",
-            MIN_WIDTH, MAX_WIDTH, MIN_HEIGHT, MAX_HEIGHT,
-            MIN_SPEED, MAX_SPEED);
+            MIN_WIDTH, MAX_WIDTH, MIN_HEIGHT, MAX_HEIGHT, MAX_WORLD_WIDTH, MAX_WORLD_HEIGHT,
+            MIN_SPEED, MAX_SPEED, CARCADE_HUD_CHAR);
 }
 
 // sets the default data
@@ -285,14 +2062,34 @@ void set_data(struct carcade_t* data, int argc, char** argv) {
     data->horizontal_char = DEFAULT_HORIZONTAL_CHAR;
     data->vertical_char = DEFAULT_VERTICAL_CHAR;
     data->clear_char = DEFAULT_CLEAR_CHAR;
-    data->ORkeys = DEFAULT_ORKEYS;
+    data->event_loop = DEFAULT_EVENT_LOOP;
+    data->hud = DEFAULT_HUD;
+    data->render = DEFAULT_RENDER;
+    data->headless = DEFAULT_HEADLESS;
+    data->seed = DEFAULT_SEED;
+    data->games = DEFAULT_GAMES;
+    data->max_ticks = DEFAULT_TICKS;
+    data->script = DEFAULT_SCRIPT;
+    data->quiet = DEFAULT_QUIET;
+    data->record = DEFAULT_RECORD;
+    data->replay = DEFAULT_REPLAY;
+    data->spectate = DEFAULT_SPECTATE;
+    data->argc = argc;
+    data->argv = argv;
+    data->key_policy = DEFAULT_KEY_POLICY;
     data->single_key = DEFAULT_SINGLE_KEY;
+    data->clear_board_buffer = DEFAULT_CLEAR_BOARD_BUFFER;
+    data->world = 0;
     data->title[0] = '\0'; 
     data->initialize = NULL;
     data->reset = NULL;
     data->move = NULL;
     data->over = NULL;
     data->stop = NULL;
+    data->save = NULL;
+    data->restore = NULL;
+    data->game = NULL;
+    data->engine = NULL;
     // parse out specials
     for (int i = 0; i < argc; i++) {
         // argument pairs
@@ -321,195 +2118,841 @@ void set_data(struct carcade_t* data, int argc, char** argv) {
             if (!strcmp(argv[i], CLEAR_CHAR_ARG)) {
                 data->clear_char = *argv[++i];
             }
+            if (!strcmp(argv[i], SEED_ARG)) {
+                data->seed = strtoul(argv[++i], NULL, 10);
+            }
+            if (!strcmp(argv[i], GAMES_ARG)) {
+                data->games = atoi(argv[++i]);
+            }
+            if (!strcmp(argv[i], TICKS_ARG)) {
+                data->max_ticks = atoll(argv[++i]);
+            }
+            if (!strcmp(argv[i], SCRIPT_ARG)) {
+                data->script = argv[++i];
+            }
+            if (!strcmp(argv[i], RECORD_ARG)) {
+                data->record = argv[++i];
+            }
+            if (!strcmp(argv[i], REPLAY_ARG)) {
+                data->replay = argv[++i];
+            }
+            if (!strcmp(argv[i], SPECTATE_ARG)) {
+                data->spectate = argv[++i];
+            }
+            if (!strcmp(argv[i], RENDER_ARG)) {
+                i++;
+                data->render = !strcmp(argv[i], RENDER_CURSES_NAME) ? render_curses
+                    : !strcmp(argv[i], RENDER_ANSI_NAME) ? render_ansi
+                    : !strcmp(argv[i], RENDER_NONE_NAME) ? render_none : -1;
+            }
         }
         // single arguments
         if (!strcmp(argv[i], KEEP_SCORE_ARG)) {
             data->keep_score = 0;
         }
+        if (!strcmp(argv[i], EVENT_LOOP_ARG)) {
+            data->event_loop = 1;
+        }
+        if (!strcmp(argv[i], HUD_ARG)) {
+            data->hud = 1;
+        }
+        if (!strcmp(argv[i], HEADLESS_ARG)) {
+            data->headless = 1;
+        }
+        if (!strcmp(argv[i], QUIET_ARG)) {
+            data->quiet = 1;
+        }
+    }
+}
+
+// closes the recording and the replay, reporting games that did not replay
+// as they were recorded
+static void stop_replay(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    if (engine->record_file) {
+        fclose(engine->record_file);
+        engine->record_file = NULL;
+    }
+    if (engine->replay_file) {
+        if (engine->replay_diverged) {
+            printf("replay: %d game(s) ended before they did when recorded\n",
+                    engine->replay_diverged);
+        }
+        fclose(engine->replay_file);
+        engine->replay_file = NULL;
+        for (uint32_t i = 1; i <= engine->replay_header.argc; i++) {
+            free(Replay_Argv[i]);
+        }
+        free(Replay_Argv);
+        Replay_Argv = NULL;
+    }
+}
+
+// releases the engine and the game state of this instance
+static void free_engine(struct carcade_t* data) {
+    stop_replay(data);
+    stop_spectate(data);
+    if (data->engine->timer_fd >= 0) {
+        close(data->engine->timer_fd);
+    }
+    if (data->engine->event_fd >= 0) {
+        close(data->engine->event_fd);
     }
+    if (data->engine->chunks) {
+        free_chunks(data);
+        free(data->engine->chunks);
+    }
+    free(data->engine->script);
+    free(data->engine);
+    free(data->game);
+    data->engine = NULL;
+    data->game = NULL;
 }
 
 // starts the arcade. allocates resources
 int start_carcade(struct carcade_t* data) {
-    // indicate not running
-    Flag_Running = 0;
-    Flag_Quit = 0;
-    Flag_Kill_Thread = 0;
-
-    // set and verify data
-    Data = data;
-    if (!Data->move) {
-        printf("error: no move function specified - report\n");
+    struct engine_t* engine;
+    uint16_t len;
+    int reading_keys = 0;
+    int screen_open = 0;
+
+    // set up the engine, indicate not running
+    engine = data->engine = calloc(1, sizeof(*engine));
+    if (!engine) {
+        printf("error: could not set up the engine\n");
+        free(data->game);
+        data->game = NULL;
         return CARCADE_GAME_QUIT;
     }
-    if (!Data->title_char || !Data->corner_char ||
-            !Data->horizontal_char || !Data->vertical_char || !Data->clear_char ||
-            Data->width < MIN_WIDTH || Data->width > MAX_WIDTH ||
-            Data->height < MIN_HEIGHT || Data->height > MAX_HEIGHT ||
-            Data->speed < MIN_SPEED || Data->speed > MAX_SPEED) {
+    engine->running = 0;
+    engine->quit = 0;
+    engine->kill_thread = 0;
+    engine->show_hud = data->hud;
+    engine->event_fd = -1;
+    engine->timer_fd = -1;
+    engine->spectate.fd = -1;
+
+    // verify data
+    if (!data->move) {
+        printf("error: no move function specified - report\n");
+        goto fail;
+    }
+    if (!data->title_char || !data->corner_char ||
+            !data->horizontal_char || !data->vertical_char || !data->clear_char ||
+            data->width < MIN_WIDTH || data->width > (data->world ? MAX_WORLD_WIDTH : MAX_WIDTH) ||
+            data->height < MIN_HEIGHT || data->height > (data->world ? MAX_WORLD_HEIGHT : MAX_HEIGHT) ||
+            data->speed < MIN_SPEED || data->speed > MAX_SPEED) {
         printf("error: something went wrong with specified metrics\n");
-        return CARCADE_GAME_QUIT;
+        goto fail;
+    }
+
+    // a world is kept in chunks allocated as it is painted
+    if (IS_WORLD(data->width, data->height)) {
+        engine->chunk_cols = (data->width + WORLD_CHUNK_SIZE - 1) / WORLD_CHUNK_SIZE;
+        engine->chunks = calloc(engine->chunk_cols * ((data->height + WORLD_CHUNK_SIZE - 1) / WORLD_CHUNK_SIZE),
+                sizeof(*engine->chunks));
+        if (!engine->chunks) {
+            printf("error: could not set up the world\n");
+            goto fail;
+        }
+    }
+
+    // pick the screen backend, headless games show nothing unless asked to
+    if (data->render == render_auto) {
+        data->render = data->headless ? render_none : render_curses;
+    }
+    switch (data->render) {
+        case render_curses:
+            engine->renderer = &Curses_Renderer;
+            break;
+        case render_ansi:
+            engine->renderer = &Ansi_Renderer;
+            break;
+        case render_none:
+            engine->renderer = &None_Renderer;
+            break;
+        default:
+            engine->renderer = NULL;
+            break;
+    }
+    if (!engine->renderer || (engine->renderer == &None_Renderer && !data->headless)) {
+        printf("error: something went wrong with the renderer\n");
+        goto fail;
+    }
+
+    // a replay continues after the recorded arguments load_replay used
+    if (data->replay) {
+        engine->replay_file = open_recording(data->replay, &engine->replay_header);
+        for (uint32_t i = 0; engine->replay_file && i < engine->replay_header.argc; i++) {
+            if (fread(&len, sizeof(len), 1, engine->replay_file) != 1 ||
+                    fseek(engine->replay_file, len, SEEK_CUR)) {
+                fclose(engine->replay_file);
+                engine->replay_file = NULL;
+            }
+        }
+        if (!engine->replay_file) {
+            printf("error: could not read the recording %s\n", data->replay);
+            goto fail;
+        }
+    }
+
+    // seed the game's random sequence, the headless input gets its own
+    if (engine->replay_file) {
+        data->seed = engine->replay_header.seed;
+    }
+    if (!data->seed) {
+        data->seed = time(0) ^ getpid();
+    }
+    engine->rand_seed = data->seed;
+    engine->input_seed = ~data->seed;
+
+    // a replay must set up the same board it was recorded on
+    if (engine->replay_file) {
+        struct record_header_t header;
+        record_header(data, &header, engine->replay_header.argc);
+        if (memcmp(&header, &engine->replay_header, sizeof(header))) {
+            printf("error: the board does not match the recording %s\n", data->replay);
+            goto fail;
+        }
+        engine->replay_diverged = 0;
+        engine->replay_run = 0;
+    }
+    if (data->record && start_record(data, data->argc, data->argv)) {
+        printf("error: could not record to %s\n", data->record);
+        goto fail;
+    }
+    if (data->spectate && start_spectate(data)) {
+        printf("error: could not publish to spectators on %s\n", data->spectate);
+        goto fail;
+    }
+
+    // headless games need no terminal or input monitoring
+    if (data->headless) {
+        if (data->games < 1 || data->max_ticks < 1) {
+            printf("error: something went wrong with the headless metrics\n");
+            goto fail;
+        }
+        if (data->script && load_script(data, data->script)) {
+            printf("error: could not read the script %s\n", data->script);
+            goto fail;
+        }
+        engine->games_played = 0;
+        engine->total_ticks = 0;
+        clock_gettime(CLOCK_MONOTONIC, &engine->start_time);
+        (*engine->renderer->open)();
+        screen_open = 1;
+        // a terminal watching is written out like a live game's and can fall
+        // behind, anything else takes every frame
+        if (engine->renderer != &None_Renderer && isatty(STDOUT_FILENO)) {
+            start_screen_out();
+        }
+        initialize_board(data);
+        if (data->initialize && (*data->initialize)(data) == CARCADE_GAME_QUIT) {
+            goto fail;
+        }
+        return 0;
+    }
+    if (data->event_loop) {
+        // stdin and the tick timer share one epoll set, no input thread
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        engine->event_fd = epoll_create1(EPOLL_CLOEXEC);
+        engine->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        event.data.fd = STDIN_FILENO;
+        if (engine->event_fd < 0 || engine->timer_fd < 0 ||
+                epoll_ctl(engine->event_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event)) {
+            printf("error: could not monitor user input\n");
+            goto fail;
+        }
+        event.data.fd = engine->timer_fd;
+        epoll_ctl(engine->event_fd, EPOLL_CTL_ADD, engine->timer_fd, &event);
     }
-    if (pthread_create(&Key_Thread, 0, get_keys, 0)) {
+    else if (pthread_create(&engine->key_thread, 0, get_keys, data)) {
         printf("error: could not monitor user input\n");
-        return CARCADE_GAME_QUIT;
+        goto fail;
     }
-    
-    // seed random
-    srand(time(0) ^ getpid());
-    
-    // setup curses screen
-    initscr();
-    noecho();
-    curs_set(0);
+    else {
+        reading_keys = 1;
+    }
+
+    // setup the screen, it is written out by its own thread when one can be
+    // started and directly otherwise
+    if ((*engine->renderer->open)()) {
+        printf("error: could not set up the screen\n");
+        goto fail;
+    }
+    screen_open = 1;
+    start_screen_out();
+
+    // redraw once per resize, restart reads so a resize is not a keystroke
+    struct sigaction resize;
+    memset(&resize, 0, sizeof(resize));
+    resize.sa_handler = handle_resize;
+    resize.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &resize, NULL);
     
     // initialize the game specific data
-    initialize_board();
-    return Data->initialize ? (*Data->initialize)(Data) : 0;
+    initialize_board(data);
+    if (data->initialize && (*data->initialize)(data) == CARCADE_GAME_QUIT) {
+        goto fail;
+    }
+    return 0;
+
+fail:
+    // undo whatever was set up, an arcade that did not start is not stopped
+    engine->kill_thread = 1;
+    if (reading_keys) {
+        pthread_join(engine->key_thread, 0);
+    }
+    if (screen_open) {
+        stop_screen_out();
+        (*engine->renderer->close)();
+    }
+    free_engine(data);
+    return CARCADE_GAME_QUIT;
+}
+
+// if a replay is requested, replaces the arguments with the recorded ones
+// followed by the given ones
+int load_replay(int* argc, char*** argv) {
+    struct record_header_t header;
+    FILE* file;
+    uint16_t len;
+    uint32_t count = 0;
+    const char* path = NULL;
+    for (int i = 1; i < *argc - 1; i++) {
+        if (!strcmp((*argv)[i], REPLAY_ARG)) {
+            path = (*argv)[++i];
+        }
+    }
+    if (!path) {
+        return 0;
+    }
+    file = open_recording(path, &header);
+    // the recorded and given arguments together must still fit argc
+    if (file && header.argc > (uint32_t)(INT_MAX - *argc)) {
+        fclose(file);
+        file = NULL;
+    }
+    if (!file) {
+        printf("error: could not read the recording %s\n", path);
+        return CARCADE_GAME_QUIT;
+    }
+    // the program name, the recorded arguments and then the given ones
+    Replay_Argv = calloc((size_t)header.argc + *argc + 1, sizeof(*Replay_Argv));
+    Replay_Argv[count++] = (*argv)[0];
+    for (uint32_t i = 0; i < header.argc; i++) {
+        if (fread(&len, sizeof(len), 1, file) != 1) {
+            break;
+        }
+        Replay_Argv[count] = calloc(len + 1, 1);
+        if (fread(Replay_Argv[count++], 1, len, file) != len) {
+            break;
+        }
+    }
+    fclose(file);
+    if (count != header.argc + 1) {
+        printf("error: could not read the recording %s\n", path);
+        return CARCADE_GAME_QUIT;
+    }
+    for (int i = 1; i < *argc; i++) {
+        Replay_Argv[count++] = (*argv)[i];
+    }
+    *argc = (int)count;
+    *argv = Replay_Argv;
+    return 0;
 }
 
 // initializes a new game
-int new_game(void) {
-    if (Flag_Kill_Thread) {
+int new_game(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    if (engine->kill_thread) {
         return CARCADE_GAME_QUIT;
     }
     // reset score, can overwrite later if needed
-    Data->score = 0;
-    Next = Data->key;
-    Flag_Quit = 0;
-    Flag_Running = 1;
-    Flag_Paint_Count = 0;
-    clear_board_contents();
+    data->score = 0;
+    engine->next = data->key;
+    // drop anything typed since the last game
+    struct keystroke_t key;
+    while (pop_key(data, &key));
+    engine->quit = 0;
+    engine->running = 1;
+    engine->game_nsec = 0;
+    engine->game_ticks = 0;
+    engine->games_played++;
+    clear_board_contents(data);
     // invoke reset if non-null
-    if (Data->reset) {
-        (*Data->reset)();
+    if (data->reset) {
+        (*data->reset)(data);
+    }
+    // paint the board after resetting and start the tick schedule
+    paint_current_board(data);
+    reset_tick(data);
+    return 0;
+}
+
+// returns the seconds of game time elapsed in the current game
+time_t game_time(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    return engine->game_nsec / 1000000000LL;
+}
+
+// returns the total bytes the ansi renderer has written
+long long rendered_bytes(void) {
+    return Ansi.bytes;
+}
+
+// returns the next number of this instance's random sequence
+int random_number(struct carcade_t* data) {
+    return rand_r(&data->engine->rand_seed);
+}
+
+// restarts the random sequences and the headless script from a seed
+void seed_game(struct carcade_t* data, unsigned int seed) {
+    struct engine_t* engine = data->engine;
+    data->seed = seed;
+    engine->rand_seed = seed;
+    engine->input_seed = ~seed;
+    engine->script_pos = 0;
+}
+
+// saves the current game into a snapshot
+int save_game(struct carcade_t* data, struct snapshot_t* snapshot) {
+    struct engine_t* engine = data->engine;
+    if (engine->chunks) {
+        return CARCADE_GAME_QUIT;
+    }
+    snapshot->score = data->score;
+    snapshot->speed = data->speed;
+    snapshot->key = data->key;
+    snapshot->next = engine->next;
+    snapshot->game_nsec = engine->game_nsec;
+    snapshot->game_ticks = engine->game_ticks;
+    snapshot->rand_seed = engine->rand_seed;
+    snapshot->input_seed = engine->input_seed;
+    snapshot->script_pos = engine->script_pos;
+    for (int row = 0; row < data->height; row++) {
+        memcpy(snapshot->board[row], engine->board[row] + engine->board_origin, data->width);
+    }
+    if (data->save) {
+        (*data->save)(data, snapshot->game);
     }
-    // paint the board after resetting
-    paint_current_board();
     return 0;
 }
 
+// puts the current game back as it was saved in a snapshot
+void restore_game(struct carcade_t* data, const struct snapshot_t* snapshot) {
+    struct engine_t* engine = data->engine;
+    // a world is never saved
+    if (engine->chunks) {
+        return;
+    }
+    data->score = snapshot->score;
+    data->speed = snapshot->speed;
+    data->key = snapshot->key;
+    engine->next = snapshot->next;
+    engine->game_nsec = snapshot->game_nsec;
+    engine->game_ticks = snapshot->game_ticks;
+    engine->rand_seed = snapshot->rand_seed;
+    engine->input_seed = snapshot->input_seed;
+    engine->script_pos = snapshot->script_pos;
+    // the shown frame is untouched, only the rows that differ from the grid
+    // are copied and compared against it again
+    for (int row = 0; row < data->height; row++) {
+        if (memcmp(engine->board[row] + engine->board_origin, snapshot->board[row], data->width)) {
+            ring_copy(engine->board[row], engine->board_origin, data->width, 0,
+                    snapshot->board[row], data->width);
+            engine->dirty[row] = 1;
+        }
+    }
+    if (data->restore) {
+        (*data->restore)(data, snapshot->game);
+    }
+}
+
 // sets a random location with the set minimum bounds
-void random_location_bound(struct location_t* loc, int row, int col) {
-    loc->row = (rand() % (Data->height - row)) + row;
-    loc->col = (rand() % (Data->width - col)) + col;
+void random_location_bound(struct carcade_t* data, struct location_t* loc, int row, int col) {
+    loc->row = (random_number(data) % (data->height - row)) + row;
+    loc->col = (random_number(data) % (data->width - col)) + col;
 }
 
 // sets a random location
-void random_location(struct location_t* loc) {
-    random_location_bound(loc, 0, 0);
+void random_location(struct carcade_t* data, struct location_t* loc) {
+    random_location_bound(data, loc, 0, 0);
 }
 
 // clears the current keystroke value, reset logic
-void clear_keystroke(void) {
-    Next = 0;
+void clear_keystroke(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    engine->next = 0;
+}
+
+// allocates the chunk of a world in its slot, all board fill and with no
+// cell occupied, returns 0 when out of memory
+static int new_chunk(struct carcade_t* data, struct chunk_t** chunk) {
+    struct engine_t* engine = data->engine;
+    if (!(*chunk = malloc(sizeof(**chunk)))) {
+        return 0;
+    }
+    memset((*chunk)->cells, data->clear_char, sizeof((*chunk)->cells));
+    memset((*chunk)->bits, 0, sizeof((*chunk)->bits));
+    (*chunk)->used = 0;
+    (*chunk)->occupied = 0;
+    if (++engine->chunk_count > engine->chunk_peak) {
+        engine->chunk_peak = engine->chunk_count;
+    }
+    return 1;
+}
+
+// frees the chunk of a world in its slot once there is nothing left in it
+static inline void drop_chunk(struct engine_t* engine, struct chunk_t** chunk) {
+    if (!(*chunk)->used && !(*chunk)->occupied) {
+        free(*chunk);
+        *chunk = NULL;
+        engine->chunk_count--;
+    }
+}
+
+// paints a character into the chunk of a world, allocating the chunk if it
+// is needed and freeing it once only the board fill is left, returns if the
+// character could be painted
+static int paint_chunk(struct carcade_t* data, struct location_t* loc, char c) {
+    struct engine_t* engine = data->engine;
+    struct chunk_t** chunk = chunk_at(engine, loc->row, loc->col);
+    char* cell;
+    if (!*chunk) {
+        if (c == data->clear_char) {
+            return 1;
+        }
+        if (!new_chunk(data, chunk)) {
+            return 0;
+        }
+    }
+    cell = &(*chunk)->cells[loc->row % WORLD_CHUNK_SIZE][loc->col % WORLD_CHUNK_SIZE];
+    (*chunk)->used += (c != data->clear_char) - (*cell != data->clear_char);
+    *cell = c;
+    drop_chunk(engine, chunk);
+    return 1;
+}
+
+// marks a cell of a world as occupied or not in the bits of its chunk
+// note:
+//  - the chunk is allocated for the mark if nothing is painted in it yet and
+//    the game is quit if the world runs out of memory
+void occupy_world_cell(struct carcade_t* data, struct location_t* loc, int on) {
+    struct engine_t* engine = data->engine;
+    struct chunk_t** chunk;
+    uint64_t bit = (uint64_t)1 << (loc->col % WORLD_CHUNK_SIZE);
+    uint64_t* bits;
+    if (!engine->chunks || loc->row >= data->height || loc->col >= data->width) {
+        return;
+    }
+    chunk = chunk_at(engine, loc->row, loc->col);
+    if (!*chunk) {
+        if (!on) {
+            return;
+        }
+        if (!new_chunk(data, chunk)) {
+            engine->quit = 1;
+            return;
+        }
+    }
+    bits = &(*chunk)->bits[loc->row % WORLD_CHUNK_SIZE];
+    (*chunk)->occupied += (on ? 1 : 0) - ((*bits & bit) ? 1 : 0);
+    *bits = on ? *bits | bit : *bits & ~bit;
+    drop_chunk(engine, chunk);
+}
+
+// returns if a cell of a world is occupied, cells off the board always are
+int world_cell_occupied(struct carcade_t* data, struct location_t* loc) {
+    struct engine_t* engine = data->engine;
+    struct chunk_t* chunk;
+    if (loc->row >= data->height || loc->col >= data->width) {
+        return 1;
+    }
+    chunk = *chunk_at(engine, loc->row, loc->col);
+    return chunk && ((chunk->bits[loc->row % WORLD_CHUNK_SIZE] >> (loc->col % WORLD_CHUNK_SIZE)) & 1);
+}
+
+// paints a single character into the game state grid and on the board
+// note:
+//  - a world is painted into its chunk and into the grid only while in view,
+//    the game is quit if the world runs out of memory
+void paint_char(struct carcade_t* data, struct location_t* loc, char c) {
+    struct engine_t* engine = data->engine;
+    unsigned int row = loc->row - engine->view_row;
+    unsigned int col = loc->col - engine->view_col;
+    if (loc->row >= data->height || loc->col >= data->width) {
+        return;
+    }
+    if (engine->chunks && !paint_chunk(data, loc, c)) {
+        engine->quit = 1;
+        return;
+    }
+    if (row < (unsigned int)engine->view_height && col < (unsigned int)engine->view_width) {
+        ring_set(engine->board[row], engine->board_origin, engine->view_width, col, c);
+        engine->dirty[row] = 1;
+    }
+}
+
+// returns the painted character at the location from the game state grid
+char painted_char(struct carcade_t* data, struct location_t* loc) {
+    struct engine_t* engine = data->engine;
+    struct chunk_t* chunk;
+    if (loc->row >= data->height || loc->col >= data->width) {
+        return '\0';
+    }
+    if (engine->chunks) {
+        chunk = *chunk_at(engine, loc->row, loc->col);
+        return chunk ? chunk->cells[loc->row % WORLD_CHUNK_SIZE][loc->col % WORLD_CHUNK_SIZE]
+            : data->clear_char;
+    }
+    return engine->board[loc->row][engine->board_origin + loc->col];
 }
 
-// paints a single character on the board
-void paint_char(struct location_t* loc, char c) {
-    if (loc->row >= 0 && loc->row < Data->height &&
-            loc->col >= 0 && loc->col < Data->width) {
-        mvaddch(CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT + loc->row,
-                CHAR_BORDER_WIDTH + loc->col, c);
+// scrolls the view of a world to keep the location away from its edges
+void follow_location(struct carcade_t* data, struct location_t* loc) {
+    struct engine_t* engine = data->engine;
+    int row;
+    int col;
+    if (!engine->chunks) {
+        return;
+    }
+    row = view_start(engine->view_row, engine->view_height, data->height, loc->row, 0);
+    col = view_start(engine->view_col, engine->view_width, data->width, loc->col, 0);
+    if (row != engine->view_row || col != engine->view_col) {
+        engine->view_row = row;
+        engine->view_col = col;
+        compose_view(data);
     }
 }
 
-// returns the painted character at the location
-char painted_char(struct location_t* loc) {
-    return A_CHARTEXT & mvinch(CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT + loc->row,
-            CHAR_BORDER_WIDTH + loc->col);
+// scrolls the board one column left leaving the last column clear
+// note:
+//  - the rows are rings, only their origins move and the new column is
+//    cleared
+//  - the shown frame is scrolled with it so only the new column and anything
+//    else painted differs from it, the screen catches up on the next paint
+//  - a shown row with only a few changes between neighboring cells costs less
+//    to resend where it changed than to shift, it is left alone
+void shift_board_left(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    int width = data->width;
+    char* prev;
+    engine->board_origin = engine->board_origin + 1 < width ? engine->board_origin + 1 : 0;
+    for (int row = 0; row < data->height; row++) {
+        ring_set(engine->board[row], engine->board_origin, width, width - 1, data->clear_char);
+        engine->dirty[row] = 1;
+    }
+    // nothing is shown without a screen
+    if (engine->renderer == &None_Renderer) {
+        return;
+    }
+    for (int row = 0; row < data->height; row++) {
+        if (engine->shown_changes[row] < SHIFT_MIN_CHANGES) {
+            continue;
+        }
+        // the first cell scrolls off and a blank one comes in last
+        prev = engine->shown[row] + engine->shown_origin[row];
+        engine->shown_changes[row] -= prev[0] != prev[1];
+        engine->shown_origin[row] = engine->shown_origin[row] + 1 < width ? engine->shown_origin[row] + 1 : 0;
+        ring_set(engine->shown[row], engine->shown_origin[row], width, width - 1, ' ');
+        prev = engine->shown[row] + engine->shown_origin[row];
+        engine->shown_changes[row] += prev[width - 2] != prev[width - 1];
+        engine->shifts[row]++;
+    }
 }
 
 // adds the given text on the line in the center of the board
-void paint_center_text(int line, const char* str) {
+void paint_center_text(struct carcade_t* data, int line, const char* str) {
+    struct engine_t* engine = data->engine;
+    struct location_t loc;
     // only paint if text fits
     int len = strlen(str);
-    if (len <= Data->width) {
-        mvaddstr(CHAR_TITLE_HEIGHT + CHAR_BORDER_HEIGHT + line,
-                CHAR_BORDER_WIDTH + (Data->width / 2) - (len / 2), str);
+    int col = (engine->view_width / 2) - (len / 2);
+    line += (engine->view_height / 2) - (data->height / 2);
+    if (len > engine->view_width || line < 0 || line >= engine->view_height) {
+        return;
+    }
+    // the text is painted into a world where it is in view, so it stays put
+    // when the view is composed again
+    if (engine->chunks) {
+        loc.row = engine->view_row + line;
+        for (int i = 0; i < len; i++) {
+            loc.col = engine->view_col + col + i;
+            paint_char(data, &loc, str[i]);
+        }
+        return;
     }
+    ring_copy(engine->board[line], engine->board_origin, engine->view_width, col, str, len);
+    engine->dirty[line] = 1;
 }
 
 // paints the current board
-int paint(void) {
-    if (Flag_Quit || Flag_Kill_Thread) {
+int paint(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    if (engine->quit || engine->kill_thread) {
         return CARCADE_GAME_QUIT;
     }
     // clear the board if specified
-    if (Data->clear_board_buffer) {
-        clear_board_contents();
+    if (data->clear_board_buffer) {
+        clear_board_contents(data);
+    }
+    // sample the tick for the overlay only while it is shown, starting a
+    // fresh window each time it is toggled on
+    long long start = 0;
+    long long moved = 0;
+    int hud = engine->show_hud && engine->renderer != &None_Renderer;
+    if (hud != engine->hud.shown) {
+        engine->hud.shown = hud;
+        engine->hud.count = 0;
+    }
+    if (hud) {
+        start = now_ns();
     }
     // make the move, move can never be null
-    int ret = (*Data->move)(next_key());
+    enum e_keystroke key = next_key(data);
+    if (engine->record_file) {
+        record_key(data, key);
+    }
+    int ret = (*data->move)(data, key);
+    engine->game_nsec += TICK_NSEC(data->speed);
+    if (hud) {
+        moved = now_ns();
+        engine->hud.start[engine->hud.count % HUD_WINDOW] = start;
+        engine->hud.move[engine->hud.count % HUD_WINDOW] = moved - start;
+        engine->hud.paint[engine->hud.count % HUD_WINDOW] = 0;
+        engine->hud.late[engine->hud.count % HUD_WINDOW] = 0;
+        engine->hud.count++;
+    }
+    // headless games end at the tick limit unless replayed in full
+    if (++engine->game_ticks >= data->max_ticks && data->headless && !engine->replay_file && ret == 0) {
+        ret = CARCADE_GAME_OVER;
+    }
     // if the result s not a quit, print the board and wait the delay
     if (ret != CARCADE_GAME_QUIT) {
-        paint_current_board();
-#ifdef SLOW_MODE
-        usleep(1000000 * SLOW_SLEEP_SEC);
-#else
-        usleep(UDELAY(Data->speed));
-#endif
+        if (!drop_frame(data)) {
+            paint_current_board(data);
+        }
+        if (hud) {
+            engine->hud.paint[(engine->hud.count - 1) % HUD_WINDOW] = now_ns() - moved;
+        }
+        wait_tick(data);
     }
     return ret;
 }
 
 // stops a running game
-int game_over(void) {
-    if (Flag_Kill_Thread) {
+int game_over(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
+    if (engine->kill_thread) {
         return CARCADE_GAME_QUIT;
     }
     char quit_buf[MAX_STRLEN];
-    int line = (Data->height / 2) - 1;
+    int line = (data->height / 2) - 1;
+    int more_games = 1;
     // indicate the game is no longer running
-    Flag_Running = 0;
+    engine->running = 0;
+    // mark the end of the recorded or replayed game, a replay stops with the
+    // last recorded game
+    if (engine->games_played && engine->record_file) {
+        record_game_end(data);
+    }
+    if (engine->replay_file) {
+        more_games = engine->games_played ? replay_game_end(data) : 1;
+    }
+    // report the headless game and start the next one until all are played
+    if (data->headless) {
+        if (engine->games_played) {
+            engine->total_ticks += engine->game_ticks;
+            if (!data->quiet) {
+                printf("game %d: score %d ticks %lld\n", engine->games_played, data->score, engine->game_ticks);
+            }
+            if (data->over) {
+                (*data->over)(data);
+            }
+        }
+        engine->quit = !more_games || (!engine->replay_file && engine->games_played >= data->games) || engine->quit;
+        return engine->quit ? CARCADE_GAME_QUIT : 0;
+    }
+    if (!more_games) {
+        engine->quit = 1;
+        return CARCADE_GAME_QUIT;
+    }
     // fill in the quit buffer with the special character
     sprintf(quit_buf, QUIT_MESSAGE_FORMAT, CARCADE_QUIT_CHAR);
     // invoke the optional game over function
-    if (Data->over && !(*Data->over)()) {
+    if (data->over && !(*data->over)(data)) {
         line++;
     }
     else {
-        paint_center_text(line++, GAME_OVER_MESSAGE);
+        paint_center_text(data, line++, GAME_OVER_MESSAGE);
     }
     // paint the messages on three separate lines
-    paint_center_text(line++, quit_buf);
-    paint_center_text(line, PLAY_MESSAGE);
-    paint_current_board();
+    paint_center_text(data, line++, quit_buf);
+    paint_center_text(data, line, PLAY_MESSAGE);
+    paint_current_board(data);
     // wait for the user input, if quit then stop and return quit
-    if (user_input() == CARCADE_QUIT_CHAR) {
-        Flag_Quit = 1;
+    if (user_input(data) == CARCADE_QUIT_CHAR) {
+        engine->quit = 1;
         return CARCADE_GAME_QUIT;
     }
     else {
-        Flag_Quit = 0;
+        engine->quit = 0;
     }
     return 0;
 }
 
 // clears the board and any other set up
-void stop_carcade(void) {
+void stop_carcade(struct carcade_t* data) {
+    struct engine_t* engine = data->engine;
     // indicate no longer running and also stopped
-    Flag_Running = 0;
-    Flag_Quit = 1;
-    Flag_Kill_Thread = 1;
+    engine->running = 0;
+    engine->quit = 1;
+    engine->kill_thread = 1;
+    // report the headless run, nothing else was set up
+    if (data->headless) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double seconds = elapsed_ns(&engine->start_time, &now) / 1e9;
+        if (data->stop) {
+            (*data->stop)(data);
+        }
+        if (!data->quiet) {
+            printf("seed %u games %d ticks %lld seconds %.3f ticks/sec %.0f\n",
+                    data->seed, engine->games_played, engine->total_ticks, seconds,
+                    seconds > 0 ? engine->total_ticks / seconds : 0);
+            if (engine->chunks) {
+                printf("world: %d chunks at most, %zu KB\n", engine->chunk_peak,
+                        engine->chunk_peak * sizeof(struct chunk_t) / 1024);
+            }
+            if (engine->renderer != &None_Renderer) {
+                printf("screen: %lld frames dropped\n", engine->dropped);
+            }
+        }
+        stop_screen_out();
+        (*engine->renderer->close)();
+        free_engine(data);
+        return;
+    }
     // wait for thread to join up
-    pthread_join(Key_Thread, 0);
+    if (!data->event_loop) {
+        pthread_join(engine->key_thread, 0);
+    }
     // clear the board before adding to it
-    clear_board_contents();
+    clear_board_contents(data);
     // invoke the stop function if non-null
-    if (Data->stop) {
-        (*Data->stop)();
+    if (data->stop) {
+        (*data->stop)(data);
     }
     // paint the exit message
-    paint_center_text((Data->height / 2) - 1, EXIT_MESSAGE);
-    paint_current_board();
-    user_input();
-    // clear the screen and end the curses window
-    clear();
-    refresh();
-    doupdate();
-    curs_set(1);
-    endwin();
+    paint_center_text(data, (data->height / 2) - 1, EXIT_MESSAGE);
+    paint_current_board(data);
+    user_input(data);
+    // clear the screen and restore the terminal
+    stop_screen_out();
+    (*engine->renderer->close)();
+    free_engine(data);
 }
 
 
@@ -6,6 +6,7 @@
 #ifndef CARCADE_H
 #define CARCADE_H
 
+#include <time.h>
 #include <unistd.h>
 
 // define this to override any speed to enable extra slow mode
@@ -20,6 +21,8 @@
 #define MAX_WIDTH                                 120
 #define MIN_HEIGHT                                6
 #define MAX_HEIGHT                                44
+#define MAX_WORLD_WIDTH                           4096
+#define MAX_WORLD_HEIGHT                          4096
 #define MIN_SPEED                                 1
 #define MAX_SPEED                                 10
 
@@ -46,10 +49,62 @@
 // logic defaults
 #define KEEP_SCORE_ARG                           "-freeplay"
 #define DEFAULT_KEEP_SCORE                        1 // true
-#define DEFAULT_ORKEYS                            0 // false -> single player
+#define EVENT_LOOP_ARG                           "-evloop"
+#define DEFAULT_EVENT_LOOP                        0 // false -> input thread
+#define HUD_ARG                                  "-hud"
+#define DEFAULT_HUD                               0 // false -> hidden
+#define DEFAULT_KEY_POLICY                        key_policy_latest
 #define DEFAULT_SINGLE_KEY                        1 // true
 #define DEFAULT_CLEAR_BOARD_BUFFER                1 // true
 
+// headless simulation defaults
+#define HEADLESS_ARG                             "-headless"
+#define DEFAULT_HEADLESS                          0 // false -> terminal
+#define SEED_ARG                                 "-seed"
+#define DEFAULT_SEED                              0 // time and pid
+#define GAMES_ARG                                "-games"
+#define DEFAULT_GAMES                             1
+#define TICKS_ARG                                "-ticks"
+#define DEFAULT_TICKS                             1000000
+#define SCRIPT_ARG                               "-script"
+#define DEFAULT_SCRIPT                            NULL // random input
+#define QUIET_ARG                                "-quiet"
+#define DEFAULT_QUIET                             0 // false -> report games
+
+// one in this many headless ticks presses a random key without a script
+#define RANDOM_KEY_ODDS                           4
+
+// recording and replay
+#define RECORD_ARG                               "-record"
+#define DEFAULT_RECORD                            NULL // not recorded
+#define REPLAY_ARG                               "-replay"
+#define DEFAULT_REPLAY                            NULL // played live
+#define RECORD_MAGIC                             "CRCD"
+#define RECORD_VERSION                            4
+
+// the keystroke log after the record header is a list of 16 bit records, the
+// low bits hold the keystroke mask handed to a move and the high bits how many
+// ticks in a row it was handed over less one, a game ends with its own record
+#define RECORD_MASK_BITS                          9
+#define RECORD_MAX_RUN                            (1 << (16 - RECORD_MASK_BITS))
+#define RECORD_GAME_END                           0xffff
+
+// spectators, the frames are sent as ansi so any terminal can watch with
+// nc -U or socat
+#define SPECTATE_ARG                             "-spectate"
+#define DEFAULT_SPECTATE                          NULL // not published
+// the most spectators watching at once and the frames queued for each one
+// before it is sent a fresh keyframe instead
+#define SPECTATE_MAX                              64
+#define SPECTATE_QUEUE                            32
+
+// renderer selection
+#define RENDER_ARG                               "-render"
+#define RENDER_CURSES_NAME                       "curses"
+#define RENDER_ANSI_NAME                         "ansi"
+#define RENDER_NONE_NAME                         "none"
+#define DEFAULT_RENDER                            render_auto
+
 // the height of the title characters and horizontal border, width of vertical
 // border
 #define CHAR_TITLE_HEIGHT                         1
@@ -60,11 +115,68 @@
 // 2 horizontal borders + title
 #define CHAR_BOARD_HEIGHT(HEIGHT) (HEIGHT + CHAR_TITLE_HEIGHT + (CHAR_BORDER_HEIGHT * 2))
 
+// macro - returns if a board is a world too big to be shown whole, only a
+// view of it around the followed location is on the screen
+#define IS_WORLD(WIDTH, HEIGHT) (WIDTH > MAX_WIDTH || HEIGHT > MAX_HEIGHT)
+
+// a world is kept in square chunks of this many cells a side, a chunk is only
+// allocated while something other than the board fill is painted in it or a
+// cell of it is occupied
+#define WORLD_CHUNK_SIZE                          64
+
+// the share of the view kept between the followed location and its edges
+// before the view scrolls
+#define VIEW_MARGIN_PERCENT                       25
+
+// the fewest changes between neighboring cells of a row worth shifting it on
+// the screen rather than resending the cells that changed
+#define SHIFT_MIN_CHANGES                         6
+
 // macro - returns the microseconds to sleep according to speed
 #define UDELAY(SPEED) (150000 / SPEED)
 
+// macro - returns the nanoseconds between the start of two ticks
+#ifdef SLOW_MODE
+#define TICK_NSEC(SPEED) ((long long)(1000000000 * SLOW_SLEEP_SEC))
+#else
+#define TICK_NSEC(SPEED) (1000LL * UDELAY(SPEED))
+#endif
+
+// the most ticks the game loop runs back to back to catch up after a stall,
+// any further behind and the missed ticks are dropped
+#define MAX_CATCHUP_TICKS                         3
+
+// the most bytes the terminal writer takes from its pipe at a time
+#define SCREEN_WRITE_SIZE                         4096
+
+// the longest run of unchanged cells merged into a changed span when painting
+#define SPAN_MERGE_GAP                            4
+
 // the timeout for getting a character, 1/10th second
 #define GETCH_TIMEOUT                             1
+#define GETCH_TIMEOUT_MS                          (GETCH_TIMEOUT * 100)
+
+// ansi renderer escape sequences
+#define ANSI_ENTER                               "\033[?1049h\033[?25l"
+#define ANSI_LEAVE                               "\033[?25h\033[?1049l"
+#define ANSI_CLEAR                               "\033[H\033[2J"
+#define ANSI_SYNC_BEGIN                          "\033[?2026h"
+#define ANSI_SYNC_END                            "\033[?2026l"
+#define ANSI_MOVE_FORMAT                         "\033[%d;%dH"
+#define ANSI_FORWARD_FORMAT                      "\033[%dC"
+#define ANSI_REPEAT_FORMAT                       "\033[%db"
+#define ANSI_ERASE_FORMAT                        "\033[%dX"
+#define ANSI_DELETE_CHAR                         "\033[P"
+#define ANSI_INSERT_CHAR                         "\033[@"
+// the shortest run of one character sent as a repeat or erase sequence
+#define ANSI_MIN_RUN                              6
+
+// the number of keystrokes buffered between the input thread and the game
+// loop, must be a power of two
+#define KEY_QUEUE_SIZE                            64
+
+// the age in ticks after which a queued turn is skipped if newer keys follow
+#define KEY_MAX_AGE_TICKS                         4
 
 
 // the quit and continue string
@@ -72,6 +184,7 @@
 #define QUIT_MESSAGE_FORMAT                      " PRESS \'%c\' TO QUIT "
 #define PLAY_MESSAGE                             " PRESS ANY KEY TO PLAY "
 #define EXIT_MESSAGE                             " PRESS ANY KEY TO EXIT "
+#define SMALL_SCREEN_FORMAT                      " RESIZE TO %dx%d "
 
 // the scoreboard format string
 #define SCOREBOARD_SCORE                         " SCORE: %d "
@@ -81,6 +194,22 @@
 #define SCOREBOARD_WIDTH_HEIGHT_SPEED            "SIZE: %dx%d  SPEED: %d "
 #endif
 
+// the performance overlay below the scoreboard, the samples it summarizes and
+// how often in ticks it is updated
+#define HUD_TICKS_FORMAT                         " %.1f TICKS/SEC"
+#define HUD_DROPPED_FORMAT                       " %lld FRAMES DROPPED"
+#define HUD_HEADER                               " P50/P99/MAX US"
+#define HUD_MOVE_FORMAT                          " MOVE  %lld/%lld/%lld"
+#define HUD_PAINT_FORMAT                         " PAINT %lld/%lld/%lld"
+#define HUD_LATE_FORMAT                          " LATE  %lld/%lld/%lld"
+#define HUD_LINES                                 6
+#define HUD_WINDOW                                128
+#define HUD_UPDATE_TICKS                          16
+
+// the room for the module state in a snapshot, the largest is the snake in
+// freeplay with its free cells and a count of the parts on each cell
+#define SNAPSHOT_GAME_SIZE                        (7 * MAX_WIDTH * MAX_HEIGHT)
+
 // max length of any predefined message
 #define MAX_STRLEN                                128
 
@@ -96,16 +225,17 @@
 #define ASCII_RIGHT_CHAR                         'd'
 #define ASCII_LEFT_CHAR                          'a'
 #define CARCADE_REFRESH_CHAR                     'r'
+#define CARCADE_HUD_CHAR                         'p'
 #define CARCADE_QUIT_CHAR                        'q'
 
 // return codes
 #define CARCADE_GAME_OVER                        -1
 #define CARCADE_GAME_QUIT                        -2
 
-// a location in a grid, size pending max width/height
+// a location in a grid, size pending max world width/height
 struct location_t {
-    unsigned char row;
-    unsigned char col;
+    unsigned short row;
+    unsigned short col;
 };
 
 // the different supported keystrokes, values may be ORed together
@@ -128,7 +258,62 @@ enum e_keystroke {
     carcade_quit =           256,
 };
 
+// how the keystrokes queued during a tick are handed to the next move
+enum e_key_policy {
+    // the last key pressed replaces any earlier ones
+    key_policy_latest,
+    // every key pressed is ORed together
+    // may be useful for multiplayer with multiple keys pressed per paint period
+    key_policy_or,
+    // one queued key that changes the direction is applied per tick, the rest
+    // wait for the following ticks so quick turn sequences are not lost
+    key_policy_turn,
+};
+
+// the screen backend used to show the board
+enum e_render {
+    // curses, or none when headless
+    render_auto,
+    render_curses,
+    render_ansi,
+    render_none,
+};
+
+// the running state of one arcade, private to carcade.c
+struct engine_t;
+
+// the state of a game at one tick, a flat block with no pointers in it so it
+// can be copied around with a single memcpy
+// note:
+//  - only what plays the game out is kept, the setup, the screen, the input
+//    thread and any recording are left as they are
+//  - only the rows of the board in play and the part of the module state in
+//    use are written, the rest of the block is left as it was
+//  - a world does not fit, only boards shown whole can be snapshotted
+struct snapshot_t {
+    // the score, the speed and keystrokes of the game
+    int score;
+    int speed;
+    enum e_keystroke key;
+    enum e_keystroke next;
+    // the game time, the random sequences and the headless script position
+    long long game_nsec;
+    long long game_ticks;
+    unsigned int rand_seed;
+    unsigned int input_seed;
+    long script_pos;
+    // the game state grid
+    char board[MAX_HEIGHT][MAX_WIDTH];
+    // the module state, laid out by the module
+    _Alignas(8) unsigned char game[SNAPSHOT_GAME_SIZE];
+};
+
 // represents the game metrics
+// note:
+//  - each game is its own context, the engine and module state hang off it so
+//    one process can run any number of games side by side
+//  - the terminal is shared by the process, only one game at a time can be
+//    shown on it and the rest have to be headless
 struct carcade_t {
     // ----- customizable setup from command line arguments -----
     // generic metrics for every game
@@ -143,6 +328,36 @@ struct carcade_t {
     char vertical_char;   // chars on sides
     char clear_char;      // chars in the middle
 
+    // bool, wait on stdin and the tick timer with epoll in the game loop
+    // instead of polling the keyboard from a separate thread
+    int event_loop;
+    // bool, start with the performance overlay shown
+    int hud;
+
+    // the screen backend
+    enum e_render render;
+
+    // bool, run without a terminal as fast as possible, painting into memory
+    int headless;
+    // the random seed, 0 seeds from the time and pid
+    unsigned int seed;
+    // the number of headless games and the tick limit of each
+    int games;
+    long long max_ticks;
+    // the headless per tick keystroke script, random keys if null
+    const char* script;
+    // bool, headless games and runs are not reported on stdout
+    int quiet;
+    // the command line the data was set from
+    int argc;
+    char** argv;
+    // the file recording the seed, board and keystrokes, not recorded if null
+    const char* record;
+    // the recording to play back instead of live input, live if null
+    const char* replay;
+    // the unix socket the frames are published on, not published if null
+    const char* spectate;
+
     // ----- game specific data, no defualts must be set on initialize -----
     // bool to keep score and if so the current score
     int keep_score;
@@ -150,70 +365,127 @@ struct carcade_t {
 
     // bool, indicates if the board is completely cleared after each paint
     int clear_board_buffer;
+    // bool, the module can play on a world bigger than the screen, it follows
+    // its player with follow_location and keeps no state of its own per cell
+    int world;
 
     // an initial set keystroke for a new game
     enum e_keystroke key;
-    // bool to indicate if keystrokes should be ORed together
-    // may be useful for multiplayer with multiple keys pressed per paint period
-    int ORkeys;
-    // bool to indicate if only key direction is accounted for... pressing right
-    // then left results in left only
+    // how queued keystrokes are applied to each move
+    enum e_key_policy key_policy;
+    // bool to indicate if only key direction is accounted for when ORing...
+    // pressing right then left results in left only
     int single_key;
 
     // title and gameplay text
     char title[MIN_WIDTH];
     
+    // the module state, allocated by the module setup and freed by stop_carcade
+    // or by start_carcade when it fails
+    void* game;
+    // the engine state, allocated by start_carcade and freed by stop_carcade or
+    // by start_carcade when it fails
+    struct engine_t* engine;
+
     // initialize the module - nullable 
     int (*initialize)(struct carcade_t* data);
     // setup/start a new game - nullable
-    int (*reset)(void);
+    int (*reset)(struct carcade_t* data);
     // advance the module specific logic (use paint_char to update board)
     // NON-NULLABLE
-    int (*move)(enum e_keystroke next);
+    int (*move)(struct carcade_t* data, enum e_keystroke next);
     // end the current game (but don't quit) - nullable
-    int (*over)(void);
+    int (*over)(struct carcade_t* data);
     // stop/quit the game - nullable
-    void (*stop)(void);
+    void (*stop)(struct carcade_t* data);
+    // copy the module state into a snapshot, at most SNAPSHOT_GAME_SIZE
+    // bytes - nullable
+    void (*save)(struct carcade_t* data, void* state);
+    // put the module state back from a snapshot - nullable
+    void (*restore)(struct carcade_t* data, const void* state);
 };
 
 // prints data about the c arcade
 void print_carcade_help(void);
 
+// if a replay is requested, replaces the arguments with the recorded ones
+// followed by the given ones, returns CARCADE_GAME_QUIT if it can't be read
+int load_replay(int* argc, char*** argv);
+
 // sets the default or overwritten data
 void set_data(struct carcade_t* data, int argc, char** argv);
 
-// starts the arcade, allocates resources
+// starts the arcade, allocates resources and frees them again if it fails
 int start_carcade(struct carcade_t* data);
 
 // initializes a new game
-int new_game(void);
+int new_game(struct carcade_t* data);
+
+// returns the seconds of game time elapsed in the current game, each move
+// advances it by one tick period whether or not the ticks are throttled
+time_t game_time(struct carcade_t* data);
+
+// returns the total bytes the ansi renderer has written
+long long rendered_bytes(void);
+
+// returns the next number from the game's own random sequence
+int random_number(struct carcade_t* data);
+
+// restarts the random sequences and the headless script from a seed, the
+// next game plays the same as any other started from that seed
+void seed_game(struct carcade_t* data, unsigned int seed);
+
+// saves the current game into a snapshot, returns CARCADE_GAME_QUIT if the
+// board is a world too big for one
+int save_game(struct carcade_t* data, struct snapshot_t* snapshot);
+
+// puts the current game back as it was saved in a snapshot, the board is
+// resent on the next paint
+void restore_game(struct carcade_t* data, const struct snapshot_t* snapshot);
 
 // sets a random location with the set minimum bounds
-void random_location_bound(struct location_t* loc, int row, int col);
+void random_location_bound(struct carcade_t* data, struct location_t* loc, int row, int col);
 
 // sets a random location
-void random_location(struct location_t* loc);
+void random_location(struct carcade_t* data, struct location_t* loc);
 
 // clears the current keystroke value, reset logic
-void clear_keystroke(void);
+void clear_keystroke(struct carcade_t* data);
+
+// paints a single character into the game state grid and on the board
+void paint_char(struct carcade_t* data, struct location_t* loc, char c);
+
+// returns the painted character at the location from the game state grid
+char painted_char(struct carcade_t* data, struct location_t* loc);
+
+// marks a cell of a world as occupied by the game or frees it again, the
+// marks are cleared with the board
+void occupy_world_cell(struct carcade_t* data, struct location_t* loc, int on);
+
+// returns if a cell of a world is occupied by the game, cells off the board
+// always are
+int world_cell_occupied(struct carcade_t* data, struct location_t* loc);
 
-// paints a single character on the board
-void paint_char(struct location_t* loc, char c);
+// scrolls the view of a world to keep the location away from its edges,
+// the whole board is always in view otherwise
+void follow_location(struct carcade_t* data, struct location_t* loc);
 
-// returns the painted character at the location
-char painted_char(struct location_t* loc);
+// scrolls the board one column left leaving the last column clear, the
+// screen is shifted to match instead of being resent, not for worlds
+void shift_board_left(struct carcade_t* data);
 
-// adds the given text on the line in the center of the board
-void paint_center_text(int line, const char* str);
+// adds the given text on the line in the center of the board, in a world
+// the lines are counted so the middle of the board is the middle of the view
+void paint_center_text(struct carcade_t* data, int line, const char* str);
 
 // paints the current board
-int paint(void);
+int paint(struct carcade_t* data);
 
 // stops a running game
-int game_over(void);
+int game_over(struct carcade_t* data);
 
 // clears resources
-void stop_carcade(void);
+void stop_carcade(struct carcade_t* data);
 
 #endif
 
@@ -15,166 +15,205 @@
 // ----- static globals --------------------------------------------------------
 
 
-// the chopper
-static struct chopper_t {
-    char chopper_char;
-    char ob_char;
+// the part of a game played out each move, copied whole to snapshot it
+struct chopper_state_t {
     struct location_t position;
     int offset;
     int ob_freq;
-    int orig_ob_freq;
-    int level_freq;
     int count;
     int peak_width;
-    int orig_peak_width;
     int level;
-    int orig_speed;
     time_t last_ob;
     time_t last_level;
-    int edge_obs[MAX_WIDTH];
-    int middle_obs[MAX_WIDTH];
-} chopper;
+    // the obstacle columns from the offset on, never taller than the board
+    signed char edge_obs[MAX_WIDTH];
+    signed char middle_obs[MAX_WIDTH];
+    signed char level_obs[MAX_WIDTH];
+};
+_Static_assert(sizeof(struct chopper_state_t) <= SNAPSHOT_GAME_SIZE,
+        "the chopper does not fit in a snapshot");
 
-// the game data
-static struct carcade_t* Data;
+// the chopper, allocated per game instance
+struct chopper_t {
+    char chopper_char;
+    char ob_char;
+    int orig_ob_freq;
+    int level_freq;
+    int orig_peak_width;
+    int orig_speed;
+    struct chopper_state_t state;
+};
 
 
 
 // ----- static functions ------------------------------------------------------
 
 
+// copies the chopper into a snapshot
+static void chopper_save(struct carcade_t* data, void* state) {
+    struct chopper_t* chopper = data->game;
+    memcpy(state, &chopper->state, sizeof(chopper->state));
+}
+
+// puts the chopper back from a snapshot
+static void chopper_restore(struct carcade_t* data, const void* state) {
+    struct chopper_t* chopper = data->game;
+    memcpy(&chopper->state, state, sizeof(chopper->state));
+}
+
 // resets the chopper game
-static int chopper_reset(void) {
+static int chopper_reset(struct carcade_t* data) {
+    struct chopper_t* chopper = data->game;
     // reset position and obstacles
-    chopper.position.row = Data->height / 2;
-    chopper.position.col = Data->width / 5;
-    chopper.offset = 0;
-    chopper.ob_freq = chopper.orig_ob_freq;
-    chopper.last_ob = time(0);
-    chopper.last_level = time(0);
-    chopper.level = Data->height / 3;
-    chopper.peak_width = chopper.orig_peak_width;
-    for (int i = 0; i < Data->width; i++) {
-        chopper.edge_obs[i] = -1;
-        chopper.middle_obs[i] = -1;
+    chopper->state.position.row = data->height / 2;
+    chopper->state.position.col = data->width / 5;
+    chopper->state.offset = 0;
+    chopper->state.ob_freq = chopper->orig_ob_freq;
+    chopper->state.last_ob = game_time(data);
+    chopper->state.last_level = game_time(data);
+    chopper->state.level = data->height / 3;
+    chopper->state.peak_width = chopper->orig_peak_width;
+    for (int i = 0; i < data->width; i++) {
+        chopper->state.edge_obs[i] = -1;
+        chopper->state.middle_obs[i] = -1;
+        chopper->state.level_obs[i] = 0;
     }
     // paint the start
-    paint_char(&chopper.position, chopper.chopper_char);
-    Data->speed = chopper.orig_speed;
-    Data->key = 0;
-    Data->score = 0;
-    clear_keystroke();
+    paint_char(data, &chopper->state.position, chopper->chopper_char);
+    data->speed = chopper->orig_speed;
+    data->key = 0;
+    data->score = 0;
+    clear_keystroke(data);
     return 0;
 }
 
+// checks the obstacle columns for an obstacle at the board location, the
+// columns are the source of truth for both painting and crashes
+static inline int obstacle_at(struct carcade_t* data, int row, int col) {
+    struct chopper_t* chopper = data->game;
+    int i = (col + chopper->state.offset) % data->width;
+    int edge = chopper->state.edge_obs[i];
+    int middle = chopper->state.middle_obs[i];
+    if (edge < 0) {
+        return 0;
+    }
+    // edge obstacles hang down to the gap and rise up to fill the level
+    return row < edge || row >= data->height - chopper->state.level_obs[i] + edge ||
+        (middle >= 0 && row == edge + middle);
+}
+
+// paints the obstacles of a board column
+static inline void paint_column(struct carcade_t* data, int col) {
+    struct chopper_t* chopper = data->game;
+    struct location_t loc;
+    loc.col = col;
+    for (loc.row = 0; loc.row < data->height; loc.row++) {
+        if (obstacle_at(data, loc.row, col)) {
+            paint_char(data, &loc, chopper->ob_char);
+        }
+    }
+}
+
 // moves the chopper, returns if result ends game
-static inline int process_position(enum e_keystroke next) {
-    if (next & (ascii_up | arrow_up) && chopper.position.row != 0) {
-        chopper.position.row--;
+static inline int process_position(struct carcade_t* data, enum e_keystroke next) {
+    struct chopper_t* chopper = data->game;
+    if (next & (ascii_up | arrow_up) && chopper->state.position.row != 0) {
+        chopper->state.position.row--;
     }
-    else if (next & (ascii_down | arrow_down) && chopper.position.row < Data->height - 1) {
-        chopper.position.row++;
+    else if (next & (ascii_down | arrow_down) && chopper->state.position.row < data->height - 1) {
+        chopper->state.position.row++;
     }
-    return painted_char(&chopper.position) != Data->clear_char ?
+    return obstacle_at(data, chopper->state.position.row, chopper->state.position.col) ?
         CARCADE_GAME_OVER : 0;
 }
 
-// returns a bool if the metric has been surpassed based on current time
-static inline int inc_metric(time_t start, int freq) {
-    return start && time(0) - start >= freq;
+// returns a bool if the metric has been surpassed based on the game time,
+// a negative start disables the metric
+static inline int inc_metric(struct carcade_t* data, time_t start, int freq) {
+    return start >= 0 && game_time(data) - start >= freq;
 }
 
 // moves the chopper and the obstacles
-static int chopper_move(enum e_keystroke next) {
+static int chopper_move(struct carcade_t* data, enum e_keystroke next) {
+    struct chopper_t* chopper = data->game;
     int ret;
     int ob_height = -1;
     int ob_pos = -1;
-    struct location_t loc;
     // if its a quit key do nothing
     if (next & carcade_quit) {
         return CARCADE_GAME_QUIT;
     }
+    // take the chopper off the board before it scrolls
+    paint_char(data, &chopper->state.position, data->clear_char);
     // check to increment level
-    if (inc_metric(chopper.last_level, chopper.level_freq)) {
-        chopper.last_level = 0;
-        chopper.last_ob = 0;
-        chopper.edge_obs[(chopper.offset + Data->width - 1) % Data->width] = -1;
-        chopper.count = 0;
+    if (inc_metric(data, chopper->state.last_level, chopper->level_freq)) {
+        chopper->state.last_level = -1;
+        chopper->state.last_ob = -1;
+        chopper->state.edge_obs[(chopper->state.offset + data->width - 1) % data->width] = -1;
+        chopper->state.count = 0;
     }
     else {
         // advance all obstacles
-        ob_height = chopper.edge_obs[(chopper.offset + Data->width - 1) % Data->width];
+        ob_height = chopper->state.edge_obs[(chopper->state.offset + data->width - 1) % data->width];
         // add new obstacle
         if (ob_height < 0) {
-            if (chopper.edge_obs[chopper.offset] < 0) {
-                chopper.position.row = Data->height / 2;
-                chopper.last_level = time(0);
-                chopper.last_ob = time(0);
-                if (Data->height - chopper.level > 5 || chopper.peak_width > 1) {
-                    if (Data->height - chopper.level > 5) {
-                        chopper.level++;
+            if (chopper->state.edge_obs[chopper->state.offset] < 0) {
+                chopper->state.position.row = data->height / 2;
+                chopper->state.last_level = game_time(data);
+                chopper->state.last_ob = game_time(data);
+                if (data->height - chopper->state.level > 5 || chopper->state.peak_width > 1) {
+                    if (data->height - chopper->state.level > 5) {
+                        chopper->state.level++;
                     }
-                    if (chopper.peak_width > 1) {
-                        chopper.peak_width--;
+                    if (chopper->state.peak_width > 1) {
+                        chopper->state.peak_width--;
                     }
                 }
-                else if (Data->speed < MAX_SPEED) {
-                    chopper.level = Data->height / 3;
-                    chopper.peak_width = chopper.orig_peak_width;
-                    Data->speed++;
+                else if (data->speed < MAX_SPEED) {
+                    chopper->state.level = data->height / 3;
+                    chopper->state.peak_width = chopper->orig_peak_width;
+                    data->speed++;
                 }
-                ob_height = rand() % (chopper.level + 1);
-                chopper.count = 0;
-                Data->score++;
+                ob_height = random_number(data) % (chopper->state.level + 1);
+                chopper->state.count = 0;
+                data->score++;
             }
         }
         // change height of previous obstacle by 1
-        else if (++chopper.count >= chopper.peak_width) {
-            chopper.count = 0;
-            switch (rand() % 3) {
+        else if (++chopper->state.count >= chopper->state.peak_width) {
+            chopper->state.count = 0;
+            switch (random_number(data) % 3) {
                 case 0:
                     if (ob_height > 0) {
                         ob_height--;
                     }
                     break;
                 case 2:
-                    if (ob_height < chopper.level) {
+                    if (ob_height < chopper->state.level) {
                         ob_height++;
                     }
                     break;
             }
         }
         // check to add a new middle obstacle
-        if (ob_height >= 0 && inc_metric(chopper.last_ob, chopper.ob_freq)) {
-            ob_pos = rand() % (Data->height - chopper.level);
-            chopper.last_ob = time(0);
+        if (ob_height >= 0 && inc_metric(data, chopper->state.last_ob, chopper->state.ob_freq)) {
+            ob_pos = random_number(data) % (data->height - chopper->state.level);
+            chopper->state.last_ob = game_time(data);
         }
     }
     // increment the obstacle locations and add them in
-    chopper.offset = (chopper.offset + 1) % Data->width;
-    chopper.edge_obs[(chopper.offset + Data->width - 1) % Data->width] = ob_height;
-    chopper.middle_obs[(chopper.offset + Data->width - 1) % Data->width] = ob_pos;
-    // paint here
-    for (int col = 0; col < Data->width; col++) {
-        loc.col = col;
-        ob_height = chopper.edge_obs[(col + chopper.offset) % Data->width];
-        ob_pos = chopper.middle_obs[(col + chopper.offset) % Data->width];
-        if (ob_height >= 0) {
-            for (int row = 0; row < chopper.level; row++) {
-                loc.row = row < ob_height ? row : Data->height - row + ob_height - 1;
-                paint_char(&loc, chopper.ob_char);
-            }
-        }
-        if (ob_height >= 0 && ob_pos >= 0) {
-            loc.row = ob_height + ob_pos;
-            paint_char(&loc, chopper.ob_char);
-        }
-    }
+    chopper->state.offset = (chopper->state.offset + 1) % data->width;
+    chopper->state.edge_obs[(chopper->state.offset + data->width - 1) % data->width] = ob_height;
+    chopper->state.middle_obs[(chopper->state.offset + data->width - 1) % data->width] = ob_pos;
+    chopper->state.level_obs[(chopper->state.offset + data->width - 1) % data->width] = chopper->state.level;
+    // scroll the board and paint only the new column
+    shift_board_left(data);
+    paint_column(data, data->width - 1);
     // move the chopper
-    ret = process_position(next);
+    ret = process_position(data, next);
     // paint the chopper
-    paint_char(&chopper.position, chopper.chopper_char);
-    clear_keystroke();
+    paint_char(data, &chopper->state.position, chopper->chopper_char);
+    clear_keystroke(data);
     return ret;
 }
 
@@ -197,29 +236,41 @@ void print_chopper_help(void) {
 
 // sets up the data for a new chopper game
 int new_chopper(struct carcade_t* data, int argc, char** argv) {
-    Data = data;
+    struct chopper_t* chopper = data->game = calloc(1, sizeof(*chopper));
+    if (!chopper) {
+        printf("error: could not set up the chopper\n");
+        return CARCADE_GAME_QUIT;
+    }
     // TODO defaults
-    chopper.chopper_char = '>';
-    chopper.ob_char = 'X';
-    chopper.orig_ob_freq = 3;
-    chopper.level_freq = 30;
-    chopper.orig_peak_width = 3;
-    chopper.orig_speed = Data->speed;
+    chopper->chopper_char = '>';
+    chopper->ob_char = 'X';
+    chopper->orig_ob_freq = 3;
+    chopper->level_freq = 30;
+    chopper->orig_peak_width = 3;
+    chopper->orig_speed = data->speed;
     // parse out custom arguments
-    if (!chopper.chopper_char || !chopper.ob_char ||
-            chopper.chopper_char == chopper.ob_char ||
-            chopper.ob_char == Data->clear_char ||
-            Data->clear_char == chopper.chopper_char) {
+    if (!chopper->chopper_char || !chopper->ob_char ||
+            chopper->chopper_char == chopper->ob_char ||
+            chopper->ob_char == data->clear_char ||
+            data->clear_char == chopper->chopper_char) {
         printf("error: something went wrong with the chopper arguments\n");
-        return CARCADE_GAME_QUIT;
+        goto fail;
     }
     // set the title and function pointer data
     int len = strlen(CHOPPER_TITLE);
-    memcpy(Data->title, CHOPPER_TITLE, len);
-    Data->title[len] = '\0';
-    Data->reset = chopper_reset;
-    Data->move = chopper_move;
+    memcpy(data->title, CHOPPER_TITLE, len);
+    data->title[len] = '\0';
+    data->clear_board_buffer = 0; // chopper scrolls its board instead
+    data->reset = chopper_reset;
+    data->move = chopper_move;
+    data->save = chopper_save;
+    data->restore = chopper_restore;
     return 0;
+
+fail:
+    free(chopper);
+    data->game = NULL;
+    return CARCADE_GAME_QUIT;
 }
 
 
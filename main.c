@@ -49,6 +49,10 @@ static int initialize_game(struct carcade_t* data, int argc, char** argv) {
 int main(int argc, char** argv) {
     int ret;
     struct carcade_t data;
+    // a replay plays the recorded game with the recorded arguments
+    if (load_replay(&argc, &argv) == CARCADE_GAME_QUIT) {
+        return -1;
+    }
     set_data(&data, argc, argv);
     // handle signal interrupt
     if (signal(SIGINT, sighand) == SIG_ERR) {
@@ -59,18 +63,18 @@ int main(int argc, char** argv) {
     if (initialize_game(&data, argc, argv) != CARCADE_GAME_QUIT &&
             start_carcade(&data) != CARCADE_GAME_QUIT) {
         // play new games until it is quit or a signal interrupt
-        while (!sigcaught && (ret = game_over()) != CARCADE_GAME_QUIT) {
+        while (!sigcaught && (ret = game_over(&data)) != CARCADE_GAME_QUIT) {
             // create new game
-            ret = new_game();
+            ret = new_game(&data);
             // continue to play until game over or signal interrupt
             while (!sigcaught && ret != CARCADE_GAME_OVER) {
                 // if the user quits give them an opportunity to play again
-                if ((ret = paint()) == CARCADE_GAME_QUIT) {
+                if ((ret = paint(&data)) == CARCADE_GAME_QUIT) {
                     ret = CARCADE_GAME_OVER;
                 }
             }
         }
-        stop_carcade();
+        stop_carcade(&data);
     }
     return 0;
 }
@@ -6,148 +6,588 @@
 
 #include "carcade.h"
 #include "snake.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
 // ----- static globals --------------------------------------------------------
 
 
-// the snake itself
-static struct snake_t {
-    char head_char;
-    char body_char;
-    char food_char;
+// the number of cells packed in each word of the body bitmap
+#define BODY_BITS 64
+
+// the directions the autopilot can steer in
+static const enum e_keystroke Auto_Keys[] = {
+    arrow_up, arrow_down, arrow_right, arrow_left
+};
+
+// the autopilot's plan, a cycle through every cell and the distances to the
+// food found so far
+struct autopilot_t {
+    // the position of each cell along the cycle
+    unsigned int order[MAX_WIDTH * MAX_HEIGHT];
+    // a search out from the food a few cells at a time, cells are part of
+    // the current search if their mark matches it
+    unsigned int food;
+    unsigned int mark;
+    unsigned int marks[MAX_WIDTH * MAX_HEIGHT];
+    unsigned int distance[MAX_WIDTH * MAX_HEIGHT];
+    unsigned int queue[MAX_WIDTH * MAX_HEIGHT];
+    unsigned int queue_head;
+    unsigned int queue_tail;
+};
+
+// the cells of the board packed into the words of the body bitmap
+#define BODY_WORDS ((MAX_WIDTH * MAX_HEIGHT + BODY_BITS - 1) / BODY_BITS)
+
+// the part of a game played out each move, copied whole to snapshot it
+// note:
+//  - the body is kept as the tail, the head and the step taken from each
+//    part to the next, two bits a step in a ring the size of the board
+//  - only the free cells in use are copied, where each one sits among them
+//    is kept apart and worked out again after a restore
+//  - a cell is only under more than one part in freeplay, so the counts of
+//    parts on each cell are only kept then and sit last to be left out of
+//    snapshots otherwise
+struct snake_state_t {
     unsigned int length;
     unsigned int offset;
-    unsigned int area;
     enum e_keystroke dir;
+    struct location_t head;
+    struct location_t tail;
     struct location_t food_loc;
-    struct location_t locations[MAX_WIDTH * MAX_HEIGHT];
-} snake;
+    // the cells not under the snake
+    unsigned int free_count;
+    // a bit set for every cell under the snake, what collisions are tested on
+    uint64_t body[BODY_WORDS];
+    // the direction from each part to the next, from the offset on
+    uint8_t steps[(MAX_WIDTH * MAX_HEIGHT + 3) / 4];
+    // the cells not under the snake packed at the front, in the order the
+    // swap removals left them
+    uint16_t free_cells[MAX_WIDTH * MAX_HEIGHT];
+    // how many parts of the snake are on each cell, freeplay only
+    uint16_t occupied[MAX_WIDTH * MAX_HEIGHT];
+};
+_Static_assert(sizeof(struct snake_state_t) <= SNAPSHOT_GAME_SIZE,
+        "the snake does not fit in a snapshot");
+_Static_assert(MAX_WIDTH * MAX_HEIGHT <= UINT16_MAX + 1,
+        "the board cells do not fit the free cell arrays");
+
+// the snake itself, allocated per game instance
+// note:
+//  - on a world collisions are tested on the occupied cells of its chunks and
+//    the steps are kept in a ring of their own that grows with the snake, the
+//    state is only used for the head, tail and food
+struct snake_t {
+    struct carcade_t* data;
+    char head_char;
+    char body_char;
+    char food_char;
+    unsigned int area;
+    struct snake_state_t state;
+    // each free cell's position in free_cells for swap removal, stale after a
+    // restore until the next cell is taken
+    uint16_t free_index[MAX_WIDTH * MAX_HEIGHT];
+    int index_stale;
+    // bool, the board is a world bigger than the screen
+    int world;
+    // the ring of steps in use and the steps it holds
+    uint8_t* ring;
+    unsigned int ring_size;
+    // if the snake steers itself and the plan it steers by
+    int autopilot;
+    struct autopilot_t plan;
+};
 
-// the game data
-static struct carcade_t* Data;
 
 
 
 // ----- static functions ------------------------------------------------------
 
 
-// gets the head of the snake
-static inline struct location_t* snake_head(void) {
-    return &snake.locations[(snake.offset + snake.length - 1) % snake.area];
+// gets the board cell number of a location
+static inline unsigned int cell_of(struct snake_t* snake, struct location_t* loc) {
+    return loc->row * snake->data->width + loc->col;
 }
 
 
-// gets the next position of the head
-static inline int next_location(struct location_t* head,
-                                enum e_keystroke key,
-                                struct location_t* new_loc) {
-    // ensure wraparound for each key direction, also ensure only positive
-    // row/col locations
+// checks if a cell is under the snake
+static inline int body_cell(struct snake_t* snake, unsigned int cell) {
+    return (snake->state.body[cell / BODY_BITS] >> (cell % BODY_BITS)) & 1;
+}
+
+
+// checks if a location is under the snake
+static inline int body_at(struct snake_t* snake, struct location_t* loc) {
+    if (snake->world) {
+        return world_cell_occupied(snake->data, loc);
+    }
+    return body_cell(snake, cell_of(snake, loc));
+}
+
+
+// marks a cell as under the snake, taking it out of the free cells
+static inline void occupy_cell(struct snake_t* snake, struct location_t* loc) {
+    struct snake_state_t* state = &snake->state;
+    unsigned int cell = cell_of(snake, loc);
+    unsigned int last;
+    if (snake->world) {
+        occupy_world_cell(snake->data, loc, 1);
+        state->free_count--;
+        return;
+    }
+    if (!snake->data->keep_score && state->occupied[cell]++) {
+        return;
+    }
+    state->body[cell / BODY_BITS] |= (uint64_t)1 << (cell % BODY_BITS);
+    // the positions are worked out again the first time one is needed after
+    // a restore
+    if (snake->index_stale) {
+        for (unsigned int i = 0; i < state->free_count; i++) {
+            snake->free_index[state->free_cells[i]] = i;
+        }
+        snake->index_stale = 0;
+    }
+    // swap the last free cell into the one taken
+    last = state->free_cells[--state->free_count];
+    state->free_cells[snake->free_index[cell]] = last;
+    snake->free_index[last] = snake->free_index[cell];
+}
+
+
+// releases a cell from the snake, returns 1 if it is now free
+static inline int release_cell(struct snake_t* snake, struct location_t* loc) {
+    struct snake_state_t* state = &snake->state;
+    unsigned int cell = cell_of(snake, loc);
+    if (snake->world) {
+        occupy_world_cell(snake->data, loc, 0);
+        state->free_count++;
+        return 1;
+    }
+    if (!snake->data->keep_score && --state->occupied[cell]) {
+        return 0;
+    }
+    state->body[cell / BODY_BITS] &= ~((uint64_t)1 << (cell % BODY_BITS));
+    snake->free_index[cell] = state->free_count;
+    state->free_cells[state->free_count++] = cell;
+    return 1;
+}
+
+
+// puts the food down on a free cell near the head of a snake on a world, or
+// anywhere once there is no room near it
+static inline void place_world_food(struct snake_t* snake) {
+    struct carcade_t* data = snake->data;
+    struct location_t* loc = &snake->state.food_loc;
+    int range = (2 * SNAKE_WORLD_FOOD_RANGE) + 1;
+    for (int tries = 0; ; tries++) {
+        if (tries < SNAKE_WORLD_FOOD_TRIES) {
+            loc->row = (snake->state.head.row + data->height - SNAKE_WORLD_FOOD_RANGE +
+                    random_number(data) % range) % data->height;
+            loc->col = (snake->state.head.col + data->width - SNAKE_WORLD_FOOD_RANGE +
+                    random_number(data) % range) % data->width;
+        }
+        else {
+            random_location(data, loc);
+        }
+        if (!world_cell_occupied(data, loc)) {
+            break;
+        }
+    }
+}
+
+
+// puts the food down on a random free cell, returns game over if the snake
+// fills the board, in freeplay it can also outgrow it by overlapping itself
+static inline int place_food(struct snake_t* snake) {
+    struct snake_state_t* state = &snake->state;
+    unsigned int cell;
+    if (!state->free_count || state->length == snake->area) {
+        return CARCADE_GAME_OVER;
+    }
+    if (snake->world) {
+        place_world_food(snake);
+        paint_char(snake->data, &state->food_loc, snake->food_char);
+        return 0;
+    }
+    cell = state->free_cells[random_number(snake->data) % state->free_count];
+    state->food_loc.row = cell / snake->data->width;
+    state->food_loc.col = cell % snake->data->width;
+    paint_char(snake->data, &state->food_loc, snake->food_char);
+    return 0;
+}
+
+
+// gets the step from one part of the snake to the next in a ring
+static inline int get_step(const uint8_t* ring, unsigned int i) {
+    return (ring[i / 4] >> ((i % 4) * 2)) & 3;
+}
+
+
+// sets the step from one part of the snake to the next in a ring
+static inline void set_step(uint8_t* ring, unsigned int i, int dir) {
+    ring[i / 4] = (ring[i / 4] & ~(3 << ((i % 4) * 2))) | (dir << ((i % 4) * 2));
+}
+
+
+// doubles the ring of a snake on a world once every step in it is taken, the
+// steps are laid out again from the tail, returns 0 on success
+static int grow_ring(struct snake_t* snake) {
+    struct snake_state_t* state = &snake->state;
+    unsigned int size = snake->ring_size * 2;
+    uint8_t* ring = calloc((size + 3) / 4, 1);
+    if (!ring) {
+        return CARCADE_GAME_QUIT;
+    }
+    for (unsigned int i = 0; i < snake->ring_size; i++) {
+        set_step(ring, i, get_step(snake->ring, (state->offset + i) % snake->ring_size));
+    }
+    free(snake->ring);
+    snake->ring = ring;
+    snake->ring_size = size;
+    state->offset = 0;
+    return 0;
+}
+
+
+// checks if the next direction turns the snake back on itself
+static inline int doubles_back(enum e_keystroke cur, enum e_keystroke next) {
+    return ((cur & (arrow_up | ascii_up)) && (next & (arrow_down | ascii_down))) ||
+        ((cur & (arrow_down | ascii_down)) && (next & (arrow_up | ascii_up))) ||
+        ((cur & (arrow_right | ascii_right)) && (next & (arrow_left | ascii_left))) ||
+        ((cur & (arrow_left | ascii_left)) && (next & (arrow_right | ascii_right)));
+}
+
+
+// gets the direction a key steers in, in the order of the autopilot keys,
+// or -1 for any other key
+static inline int key_dir(enum e_keystroke key) {
     if (key & (arrow_up | ascii_up)) {
-        new_loc->row = (head->row + Data->height - 1) % Data->height;
-        new_loc->col = head->col;
+        return 0;
     }
     else if (key & (arrow_down | ascii_down)) {
-        new_loc->row = (head->row + 1) % Data->height;
-        new_loc->col = head->col;
+        return 1;
     }
     else if (key & (arrow_right | ascii_right)) {
-        new_loc->row = head->row;
-        new_loc->col = (head->col + 1) % Data->width;
+        return 2;
     }
     else if (key & (arrow_left | ascii_left)) {
-        new_loc->row = head->row;
-        new_loc->col = (head->col + Data->width - 1) % Data->width;
+        return 3;
     }
-    // any other key we don't know what to do with so error out
-    else {
-        return CARCADE_GAME_OVER;
+    return -1;
+}
+
+
+// moves a location one cell in a direction, wrapping around the board
+static inline void step_location(struct snake_t* snake, struct location_t* loc, int dir) {
+    struct carcade_t* data = snake->data;
+    switch (dir) {
+        case 0:
+            loc->row = (loc->row + data->height - 1) % data->height;
+            break;
+        case 1:
+            loc->row = (loc->row + 1) % data->height;
+            break;
+        case 2:
+            loc->col = (loc->col + 1) % data->width;
+            break;
+        default:
+            loc->col = (loc->col + data->width - 1) % data->width;
+            break;
     }
-    return 0;
+}
+
+
+// numbers the cells along a cycle that visits each one once
+// note:
+//  - an even number of rows is covered by running right along the top row,
+//    back and forth over the other columns on the way down and then back up
+//    the first column
+//  - with an odd number of rows the last one is spliced in below the row
+//    above it, leaving it at column 2 and wrapping around to come back up at
+//    column 1
+static void build_cycle(struct snake_t* snake) {
+    struct autopilot_t* plan = &snake->plan;
+    struct carcade_t* data = snake->data;
+    int rows = data->height & ~1;
+    int width = data->width;
+    unsigned int pos = 0;
+    for (int c = 0; c < width; c++) {
+        plan->order[c] = pos++;
+    }
+    for (int r = 1; r < rows; r++) {
+        for (int i = 1; i < width; i++) {
+            int c = r & 1 ? width - i : i;
+            plan->order[r * width + c] = pos++;
+            if (rows < data->height && r == rows - 1 && c == 2) {
+                for (int j = 0; j < width; j++) {
+                    plan->order[rows * width + (2 + j) % width] = pos++;
+                }
+            }
+        }
+    }
+    for (int r = rows - 1; r > 0; r--) {
+        plan->order[r * width] = pos++;
+    }
+}
+
+
+// gets the distance from one cell to another going forward along the cycle
+static inline unsigned int cycle_distance(struct snake_t* snake, unsigned int from, unsigned int to) {
+    return (snake->plan.order[to] + snake->area - snake->plan.order[from]) % snake->area;
+}
+
+
+// gets the cell next to another in a direction, wrapping around the board
+static inline unsigned int neighbor_cell(struct snake_t* snake, unsigned int cell, int dir) {
+    struct carcade_t* data = snake->data;
+    unsigned int row = cell / data->width;
+    unsigned int col = cell % data->width;
+    switch (dir) {
+        case 0:
+            return ((row + data->height - 1) % data->height) * data->width + col;
+        case 1:
+            return ((row + 1) % data->height) * data->width + col;
+        case 2:
+            return row * data->width + (col + 1) % data->width;
+        default:
+            return row * data->width + (col + data->width - 1) % data->width;
+    }
+}
+
+
+// carries on the search out from the food for a bounded number of cells,
+// starting over whenever the food moves
+static void auto_search(struct snake_t* snake) {
+    struct autopilot_t* plan = &snake->plan;
+    unsigned int food = cell_of(snake, &snake->state.food_loc);
+    unsigned int cell;
+    unsigned int next;
+    if (plan->food != food || !plan->mark) {
+        plan->food = food;
+        // the marks of the last search are left to go stale
+        if (!++plan->mark) {
+            memset(plan->marks, 0, sizeof(plan->marks));
+            plan->mark = 1;
+        }
+        plan->marks[food] = plan->mark;
+        plan->distance[food] = 0;
+        plan->queue[0] = food;
+        plan->queue_head = 0;
+        plan->queue_tail = 1;
+    }
+    for (int n = 0; n < SNAKE_AUTO_SEARCH_CELLS && plan->queue_head < plan->queue_tail; n++) {
+        cell = plan->queue[plan->queue_head++];
+        for (int dir = 0; dir < 4; dir++) {
+            next = neighbor_cell(snake, cell, dir);
+            if (plan->marks[next] != plan->mark && !body_cell(snake, next)) {
+                plan->marks[next] = plan->mark;
+                plan->distance[next] = plan->distance[cell] + 1;
+                plan->queue[plan->queue_tail++] = next;
+            }
+        }
+    }
+}
+
+
+// picks the autopilot's next direction
+// note:
+//  - the body always lies on the stretch of the cycle from the tail to the
+//    head, so any move forward along the cycle that stays short of the tail
+//    and the food keeps the snake safe
+//  - of those the one closest to the food by the search is taken, or the
+//    one furthest along the cycle where the search has not reached yet
+static enum e_keystroke auto_key(struct snake_t* snake) {
+    struct autopilot_t* plan = &snake->plan;
+    struct snake_state_t* state = &snake->state;
+    unsigned int head = cell_of(snake, &state->head);
+    unsigned int tail = cell_of(snake, &state->tail);
+    unsigned int to_tail = cycle_distance(snake, head, tail);
+    unsigned int to_food = cycle_distance(snake, head, cell_of(snake, &state->food_loc));
+    unsigned int best_distance = 0;
+    unsigned int best_ahead = 0;
+    int shortcuts = state->length < snake->area * SNAKE_AUTO_SHORTCUT_PERCENT / 100;
+    int best = -1;
+    auto_search(snake);
+    if (!to_tail) {
+        to_tail = snake->area;
+    }
+    for (int dir = 0; dir < 4; dir++) {
+        unsigned int next = neighbor_cell(snake, head, dir);
+        unsigned int ahead = cycle_distance(snake, head, next);
+        unsigned int distance = plan->marks[next] == plan->mark ? plan->distance[next] : ~0u;
+        if ((state->length > 1 && doubles_back(state->dir, Auto_Keys[dir])) || body_cell(snake, next)) {
+            continue;
+        }
+        if (ahead != 1 && (!shortcuts || ahead > to_food ||
+                    ahead + SNAKE_AUTO_TAIL_GAP >= to_tail)) {
+            continue;
+        }
+        if (best < 0 || distance < best_distance ||
+                (distance == best_distance && ahead > best_ahead)) {
+            best = dir;
+            best_distance = distance;
+            best_ahead = ahead;
+        }
+    }
+    return best < 0 ? state->dir : Auto_Keys[best];
+}
+
+
+// copies the snake state in use, the free cells as far as there are any and
+// the part counts only in freeplay
+static inline void copy_state(struct snake_t* snake, struct snake_state_t* to,
+                              const struct snake_state_t* from) {
+    memcpy(to, from, offsetof(struct snake_state_t, free_cells));
+    memcpy(to->free_cells, from->free_cells, from->free_count * sizeof(*from->free_cells));
+    if (!snake->data->keep_score) {
+        memcpy(to->occupied, from->occupied, snake->area * sizeof(*from->occupied));
+    }
+}
+
+
+// copies the snake into a snapshot
+static void snake_save(struct carcade_t* data, void* state) {
+    struct snake_t* snake = data->game;
+    copy_state(snake, state, &snake->state);
+}
+
+
+// puts the snake back from a snapshot, the autopilot starts its search over
+// on the board as restored
+static void snake_restore(struct carcade_t* data, const void* state) {
+    struct snake_t* snake = data->game;
+    copy_state(snake, &snake->state, state);
+    snake->index_stale = 1;
+    snake->plan.mark = 0;
+}
+
+
+// frees the ring of a snake on a world
+static void snake_stop(struct carcade_t* data) {
+    struct snake_t* snake = data->game;
+    free(snake->ring);
+    snake->ring = NULL;
 }
 
 
 // resets the snake game
-static int snake_reset(void) {
+static int snake_reset(struct carcade_t* data) {
+    struct snake_t* snake = data->game;
+    struct snake_state_t* state = &snake->state;
     // reset the snake data
-    snake.offset = 0;
-    snake.length = 1;//(Data->width < Data->height ? Data->width : Data->height) / 5;
-    snake.area = Data->width * Data->height;
+    state->offset = 0;
+    state->length = 1;//(data->width < data->height ? data->width : data->height) / 5;
+    snake->area = data->width * data->height;
+    // the steps on a world are kept apart, otherwise a step for every cell
+    if (!snake->world) {
+        snake->ring = state->steps;
+        snake->ring_size = snake->area;
+    }
     // set the starting direction
-    snake.dir = arrow_right;
-    Data->key = snake.dir;
-    // reset the locations
-    for (int i = 0; i < snake.length; i++) {
-        snake.locations[i].row = 0;
-        snake.locations[i].col = i;
-        paint_char(&snake.locations[i], i == snake.length - 1
-                ? snake.head_char : snake.body_char);
+    state->dir = arrow_right;
+    data->key = state->dir;
+    // the autopilot plans over the whole board
+    if (snake->autopilot) {
+        build_cycle(snake);
+        snake->plan.mark = 0;
+    }
+    // every cell starts free
+    state->free_count = snake->area;
+    if (!snake->world) {
+        memset(state->body, 0, sizeof(state->body));
+        for (unsigned int i = 0; i < snake->area; i++) {
+            state->free_cells[i] = i;
+            snake->free_index[i] = i;
+        }
+        snake->index_stale = 0;
+    }
+    if (!data->keep_score) {
+        memset(state->occupied, 0, sizeof(state->occupied));
     }
+    // lay the snake out from the corner, or the middle of a world
+    state->tail.row = snake->world ? data->height / 2 : 0;
+    state->tail.col = snake->world ? data->width / 2 : 0;
+    state->head = state->tail;
+    for (unsigned int i = 0; i < state->length; i++) {
+        if (i) {
+            set_step(snake->ring, i - 1, key_dir(arrow_right));
+            step_location(snake, &state->head, key_dir(arrow_right));
+        }
+        occupy_cell(snake, &state->head);
+        paint_char(data, &state->head, i == state->length - 1
+                ? snake->head_char : snake->body_char);
+    }
+    follow_location(data, &state->head);
     // assign a random food spot anywhere where the snake is not right now
-    random_location_bound(&snake.food_loc, 1, snake.length);
-    paint_char(&snake.food_loc, snake.food_char);
-    return 0;
+    return place_food(snake);
 }
 
 
 // moves the snake in the given direction
-static int snake_move(enum e_keystroke next) {
-    struct location_t head;
-    struct location_t* loc;
-    int ret = CARCADE_GAME_OVER;
+static int snake_move(struct carcade_t* data, enum e_keystroke next) {
+    struct snake_t* snake = data->game;
+    struct snake_state_t* state = &snake->state;
+    struct location_t head = state->head;
+    int dir;
     // if its a quit key do nothing
     if (next & carcade_quit) {
         return CARCADE_GAME_QUIT;
     }
     // can't double back, keep going the same direction if the next is
     // immediately backwards
-    if (!next ||
-            (snake.dir & (arrow_up | ascii_up)) && (next & (arrow_down | ascii_down)) ||
-            (snake.dir & (arrow_down | ascii_down)) && (next & (arrow_up | ascii_up)) ||
-            (snake.dir & (arrow_right | ascii_right)) && (next & (arrow_left | ascii_left)) ||
-            (snake.dir & (arrow_left | ascii_left)) && (next & (arrow_right | ascii_right))) {
-        next = snake.dir;
-    }
-    // make sure the next move does not end the game before continuing
-    if (next_location(snake_head(), next, &head) != CARCADE_GAME_OVER) {
-        // if the head hits the body the game is over
-        if (Data->keep_score && painted_char(&head) == snake.body_char) {
-            return CARCADE_GAME_OVER;
-        }
-        // overwrite the current head
-        paint_char(snake_head(), snake.body_char);
-        // if head eats food, increase the length/score and put down new food
-        if (head.row == snake.food_loc.row && head.col == snake.food_loc.col) {
-            snake.length++;
-            Data->score++;
-            random_location(&snake.food_loc);
-            // paint the new food, old was overwritten
-            paint_char(&snake.food_loc, snake.food_char);
-        }
-        else {
-            // increase offset and erase the tail if it is not the food
-            // random food locations means the food can overlap the body
-            loc = &snake.locations[snake.offset];
-            if (loc->row != snake.food_loc.row || loc->col != snake.food_loc.col) {
-                paint_char(&snake.locations[snake.offset], Data->clear_char);
-            }
-            snake.offset = (snake.offset + 1) % snake.area;
-        }
-        // move the head
-        loc = snake_head();
-        loc->row = head.row;
-        loc->col = head.col;
-        // paint the head if it is not overlapped by the food
-        if (head.row != snake.food_loc.row || head.col != snake.food_loc.col) {
-            paint_char(&head, snake.head_char);
+    if (snake->autopilot) {
+        next = auto_key(snake);
+    }
+    if (!next || doubles_back(state->dir, next)) {
+        next = state->dir;
+    }
+    // any other key we don't know what to do with so error out
+    dir = key_dir(next);
+    if (dir < 0) {
+        return CARCADE_GAME_OVER;
+    }
+    step_location(snake, &head, dir);
+    // if the head hits the body the game is over, the tail has not moved up
+    // yet so running into it counts
+    if (data->keep_score && body_at(snake, &head)) {
+        return CARCADE_GAME_OVER;
+    }
+    // overwrite the current head and step on from it, a full ring on a world
+    // grows first
+    if (state->length == snake->ring_size && grow_ring(snake)) {
+        return CARCADE_GAME_QUIT;
+    }
+    paint_char(data, &state->head, snake->body_char);
+    set_step(snake->ring, (state->offset + state->length - 1) % snake->ring_size, dir);
+    // if head eats food increase the length/score, otherwise the tail moves
+    // up and its cell is erased unless the snake still covers it
+    if (head.row == state->food_loc.row && head.col == state->food_loc.col) {
+        state->length++;
+        data->score++;
+    }
+    else {
+        if (release_cell(snake, &state->tail)) {
+            paint_char(data, &state->tail, data->clear_char);
         }
-        snake.dir = next;
-        ret = 0;
+        step_location(snake, &state->tail, get_step(snake->ring, state->offset));
+        state->offset = (state->offset + 1) % snake->ring_size;
+    }
+    // move the head
+    state->head = head;
+    occupy_cell(snake, &head);
+    paint_char(data, &head, snake->head_char);
+    follow_location(data, &head);
+    // put down new food once eaten, the game is won if there is no room
+    if (head.row == state->food_loc.row && head.col == state->food_loc.col &&
+            place_food(snake) == CARCADE_GAME_OVER) {
+        return CARCADE_GAME_OVER;
     }
-    return ret;
+    state->dir = next;
+    return 0;
 }
 
 
@@ -162,7 +602,8 @@ void print_snake_help(void) {
             "additional arguments for" SNAKE_TITLE "    %c%c%c%c%c%c%c%c %c\n\t"
             SNAKE_HEAD_ARG "\tchar - the head style\n\t"
             SNAKE_BODY_ARG "\tchar - the body style\n\t"
-            SNAKE_FOOD_ARG "\tchar - the food style\n\n",
+            SNAKE_FOOD_ARG "\tchar - the food style\n\t"
+            SNAKE_AUTO_ARG "\t     - the snake steers itself\n\n",
             body, body, body, body, body, body, body,
             SNAKE_DEFAULT_HEAD_CHAR, SNAKE_DEFAULT_FOOD_CHAR);
 
@@ -170,37 +611,76 @@ void print_snake_help(void) {
 
 // sets up the data for a new snake game
 int new_snake(struct carcade_t* data, int argc, char** argv) {
-    Data = data;
-    snake.head_char = SNAKE_DEFAULT_HEAD_CHAR;
-    snake.body_char = SNAKE_DEFAULT_BODY_CHAR;
-    snake.food_char = SNAKE_DEFAULT_FOOD_CHAR;
+    struct snake_t* snake = data->game = calloc(1, sizeof(*snake));
+    if (!snake) {
+        printf("error: could not set up the snake\n");
+        return CARCADE_GAME_QUIT;
+    }
+    snake->data = data;
+    snake->head_char = SNAKE_DEFAULT_HEAD_CHAR;
+    snake->body_char = SNAKE_DEFAULT_BODY_CHAR;
+    snake->food_char = SNAKE_DEFAULT_FOOD_CHAR;
+    snake->autopilot = 0;
     // parse out custom arguments
     for (int i = 0; i < argc - 1; i++) {
         if (!strcmp(SNAKE_HEAD_ARG, argv[i])) {
-            snake.head_char = *argv[++i];
+            snake->head_char = *argv[++i];
         }
         else if (!strcmp(SNAKE_BODY_ARG, argv[i])) {
-            snake.body_char = *argv[++i];
+            snake->body_char = *argv[++i];
         }
         else if (!strcmp(SNAKE_FOOD_ARG, argv[i])) {
-            snake.food_char = *argv[++i];
+            snake->food_char = *argv[++i];
         }
     }
-    if (!snake.head_char || !snake.body_char || !snake.food_char ||
-            snake.head_char == snake.body_char || snake.head_char == Data->clear_char ||
-            snake.body_char == snake.food_char || snake.body_char == Data->clear_char ||
-            snake.food_char == snake.head_char || snake.food_char == Data->clear_char) {
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(SNAKE_AUTO_ARG, argv[i])) {
+            snake->autopilot = 1;
+        }
+    }
+    // a world only has room for the snake on the board, the autopilot plans
+    // and freeplay counts every cell
+    snake->world = IS_WORLD(data->width, data->height);
+    if (snake->world && (snake->autopilot || !data->keep_score)) {
+        printf("error: a snake on a world keeps score and steers by hand\n");
+        goto fail;
+    }
+    if (snake->world) {
+        snake->ring_size = SNAKE_WORLD_RING_SIZE;
+        snake->ring = calloc(snake->ring_size / 4, 1);
+        if (!snake->ring) {
+            printf("error: could not set up the snake\n");
+            goto fail;
+        }
+        data->stop = snake_stop;
+    }
+    if (!snake->head_char || !snake->body_char || !snake->food_char ||
+            snake->head_char == snake->body_char || snake->head_char == data->clear_char ||
+            snake->body_char == snake->food_char || snake->body_char == data->clear_char ||
+            snake->food_char == snake->head_char || snake->food_char == data->clear_char) {
         printf("error: something went wrong with the snake arguments\n");
-        return CARCADE_GAME_QUIT;
+        goto fail;
     }
     // set the title and function pointer data
     int len = strlen(SNAKE_TITLE);
-    memcpy(Data->title, SNAKE_TITLE, len);
-    Data->clear_board_buffer = 0; // snake remains mostly similar between paints
-    Data->title[len] = '\0';
-    Data->reset = snake_reset;
-    Data->move = snake_move;
+    memcpy(data->title, SNAKE_TITLE, len);
+    data->clear_board_buffer = 0; // snake remains mostly similar between paints
+    data->key_policy = key_policy_turn; // one turn per move, never drop a turn
+    data->title[len] = '\0';
+    data->reset = snake_reset;
+    data->move = snake_move;
+    data->save = snake_save;
+    data->restore = snake_restore;
+    data->world = 1;
     return 0;
+
+fail:
+    // the ring is only there on a world
+    free(snake->ring);
+    free(snake);
+    data->game = NULL;
+    data->stop = NULL;
+    return CARCADE_GAME_QUIT;
 }
 
 
@@ -13,12 +13,26 @@
 #define SNAKE_HEAD_ARG "-snake-head"
 #define SNAKE_BODY_ARG "-snake-body"
 #define SNAKE_FOOD_ARG "-snake-food"
+#define SNAKE_AUTO_ARG "-snake-auto"
 
 // the snakes representation
 #define SNAKE_DEFAULT_HEAD_CHAR 'o'
 #define SNAKE_DEFAULT_BODY_CHAR '.'
 #define SNAKE_DEFAULT_FOOD_CHAR '@'
 
+// the autopilot takes shortcuts off its cycle until the snake covers this
+// share of the board, leaves this many cells between the head and the tail
+// and searches this many cells toward the food each tick
+#define SNAKE_AUTO_SHORTCUT_PERCENT 50
+#define SNAKE_AUTO_TAIL_GAP 4
+#define SNAKE_AUTO_SEARCH_CELLS 256
+
+// on a world the food is dropped within this many cells of the head for this
+// many tries before anywhere will do, and the ring of steps starts this big
+#define SNAKE_WORLD_FOOD_RANGE 16
+#define SNAKE_WORLD_FOOD_TRIES 64
+#define SNAKE_WORLD_RING_SIZE 256
+
 // title and game over strings
 #define SNAKE_TITLE " SNAKE "
 
@@ -6,28 +6,162 @@
 
 #include "carcade.h"
 #include "tron.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
 
 
 // ----- static globals --------------------------------------------------------
 
 
-// the tron players
-static struct tron_t {
-    char player1_char;
-    char player2_char;
-    char vertical_char;
-    char horizontal_char;
+// the words in each bitboard row, a bit for every column
+#define ROW_WORDS ((MAX_WIDTH + 63) / 64)
+
+// a score past any territory difference for a won or lost position
+#define CPU_WIN (MAX_WIDTH * MAX_HEIGHT + 1)
+
+// a netplay tick that has to wait for the other player's input
+#define NET_WAIT 1
+
+// a bit for every cell on the board
+struct bits_t {
+    uint64_t row[MAX_HEIGHT][ROW_WORDS];
+};
+
+// the directions a bike can move in, in the order the computer tries them
+enum e_dir {
+    dir_up,
+    dir_down,
+    dir_right,
+    dir_left,
+    dir_count
+};
+
+// the keys that move each player in each direction
+static const enum e_keystroke Player_Keys[2][dir_count] = {
+    { ascii_up, ascii_down, ascii_right, ascii_left },
+    { arrow_up, arrow_down, arrow_right, arrow_left }
+};
+
+
+// the state of a computer search
+struct search_t {
+    long long deadline;
+    int max_depth;
+    int aborted;
+    long long nodes;
+};
+
+// the part of a game played out each tick, copied whole to snapshot it
+struct tron_state_t {
     enum e_keystroke player1_dir;
     enum e_keystroke player2_dir;
     struct location_t player1_loc;
     struct location_t player2_loc;
     char over_message[TRON_MAX_MESSAGE_LEN];
-} tron;
+    // the cells that are free to ride on, kept apart from the screen
+    struct bits_t open;
+};
+_Static_assert(sizeof(struct tron_state_t) <= SNAPSHOT_GAME_SIZE,
+        "tron does not fit in a snapshot");
+
+// the input of one player for one tick, sent to the other player as soon as
+// it is decided, in network byte order
+struct net_input_t {
+    uint16_t game;
+    uint16_t key;
+    uint32_t frame;
+};
 
-// the game data
-static struct carcade_t* Data;
+// what both players send on connecting, the boards have to match
+struct net_hello_t {
+    char magic[4];
+    uint16_t width;
+    uint16_t height;
+    uint16_t speed;
+    uint16_t unused;
+};
+
+// an input waiting out the simulated lag
+struct net_outgoing_t {
+    long long due;
+    struct net_input_t input;
+};
+
+// the netplay link to the other player and the ticks played on a guess
+// note:
+//  - a tick is played as soon as the local input is known, the other
+//    player's input is guessed to be no turn until it arrives
+//  - the state before every tick not yet confirmed is kept, a wrong guess
+//    plays the game again from the tick it was wrong on
+//  - a tick that would end the game on a guess waits for the real input, so
+//    both players always see the same ending
+struct net_t {
+    // the socket, -1 if not netplay, and the player ridden here
+    int fd;
+    int player;
+    int closed;
+    // the game and the next tick to play, the ticks the local input was sent
+    // for and the ticks the other player's input arrived for
+    uint16_t game;
+    uint32_t frame;
+    uint32_t sent;
+    uint32_t received;
+    // the first tick played on a wrong guess, none if past the frame
+    uint32_t rollback_from;
+    // the local keys pressed since the last tick was decided
+    uint16_t pending;
+    // the inputs and the guess and state each tick was played with
+    uint16_t local[TRON_NET_ROLLBACK];
+    uint16_t remote[2 * TRON_NET_ROLLBACK];
+    uint16_t guess[TRON_NET_ROLLBACK];
+    struct tron_state_t snapshots[TRON_NET_ROLLBACK];
+    // a message read in part, or whole and held until its game starts
+    unsigned char message[sizeof(struct net_input_t)];
+    int message_len;
+    // the simulated lag
+    int lag_ms;
+    int jitter_ms;
+    unsigned int jitter_seed;
+    struct net_outgoing_t outgoing[2 * TRON_NET_ROLLBACK];
+    unsigned int out_head;
+    unsigned int out_tail;
+    // how much had to be played again, the most in one tick and the longest
+    long long rollbacks;
+    long long rolled_back;
+    int max_rolled_back;
+    long long max_rollback_nsec;
+};
+
+// the tron players, allocated per game instance
+struct tron_t {
+    struct carcade_t* data;
+    char player1_char;
+    char player2_char;
+    char vertical_char;
+    char horizontal_char;
+    // the players the computer drives, a bit for each
+    int cpu;
+    // bool, the arena is a world bigger than the screen, the board is what
+    // the bikes crash into instead of the open cells of the state
+    int world;
+    struct tron_state_t state;
+    // the search of the computer player deciding this tick
+    struct search_t search;
+    // the other player when playing over the network
+    struct net_t net;
+};
 
 
 
@@ -37,16 +171,53 @@ static struct carcade_t* Data;
 // sets the next direction based on the current
 static inline enum e_keystroke turn_player(enum e_keystroke cur, enum e_keystroke new) {
     if (!new ||
-            (cur & (arrow_up | ascii_up)) && (new & (arrow_down | ascii_down)) ||
-            (cur & (arrow_down | ascii_down)) && (new & (arrow_up | ascii_up)) ||
-            (cur & (arrow_right | ascii_right)) && (new & (arrow_left | ascii_left)) ||
-            (cur & (arrow_left | ascii_left)) && (new & (arrow_right | ascii_right))) {
+            ((cur & (arrow_up | ascii_up)) && (new & (arrow_down | ascii_down))) ||
+            ((cur & (arrow_down | ascii_down)) && (new & (arrow_up | ascii_up))) ||
+            ((cur & (arrow_right | ascii_right)) && (new & (arrow_left | ascii_left))) ||
+            ((cur & (arrow_left | ascii_left)) && (new & (arrow_right | ascii_right)))) {
         new = cur;
     }
     return new;
 }
-// sets the next position of both players based on the key
-static inline int advance_player(struct location_t* loc, enum e_keystroke key, struct location_t* new) {
+
+// sets or clears a cell in a bitboard
+static inline void set_bit(struct bits_t* bits, struct location_t* loc, int on) {
+    uint64_t bit = (uint64_t)1 << (loc->col % 64);
+    if (on) {
+        bits->row[loc->row][loc->col / 64] |= bit;
+    }
+    else {
+        bits->row[loc->row][loc->col / 64] &= ~bit;
+    }
+}
+
+// checks a cell in a bitboard, cells off the board are never set, a step off
+// the top or left edge wraps the unsigned location past the far edge
+static inline int get_bit(struct tron_t* tron, struct bits_t* bits, struct location_t* loc) {
+    if (loc->row >= tron->data->height || loc->col >= tron->data->width) {
+        return 0;
+    }
+    return (bits->row[loc->row][loc->col / 64] >> (loc->col % 64)) & 1;
+}
+
+// checks if a cell is free to ride on, a world keeps the trails in the
+// occupied cells of its chunks
+static inline int cell_open(struct tron_t* tron, struct location_t* loc) {
+    if (tron->world) {
+        return !world_cell_occupied(tron->data, loc);
+    }
+    return get_bit(tron, &tron->state.open, loc);
+}
+
+// moves a location one step in a direction, off the board is left to get_bit
+static inline void step(struct location_t* loc, int dir, struct location_t* new) {
+    new->row = loc->row + (dir == dir_down) - (dir == dir_up);
+    new->col = loc->col + (dir == dir_right) - (dir == dir_left);
+}
+
+// sets the next position of a player based on the key, anything but an
+// open cell crashes
+static inline int advance_player(struct tron_t* tron, struct location_t* loc, enum e_keystroke key, struct location_t* new) {
     if (key & (arrow_up | ascii_up)) {
         new->row = loc->row - 1;
         new->col = loc->col;
@@ -67,41 +238,282 @@ static inline int advance_player(struct location_t* loc, enum e_keystroke key, s
     else {
         return CARCADE_GAME_OVER;
     }
-    return new->row < 0 || new->row >= Data->height || new->col < 0 || new->col >= Data->width ||
-        painted_char(new) != Data->clear_char ? CARCADE_GAME_OVER : 0; 
+    return cell_open(tron, new) ? 0 : CARCADE_GAME_OVER;
+}
+
+// gets the monotonic time in nanoseconds
+static inline long long cpu_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// gets the cells next to the frontier in a row word, a row is a few words so
+// the whole row moves left or right with a shift that carries across words
+static inline uint64_t spread(struct tron_t* tron, struct bits_t* frontier, int r, int w) {
+    uint64_t cur = frontier->row[r][w];
+    uint64_t cells = cur | (cur << 1) | (cur >> 1);
+    if (w > 0) {
+        cells |= frontier->row[r][w - 1] >> 63;
+    }
+    if (w < ROW_WORDS - 1) {
+        cells |= frontier->row[r][w + 1] << 63;
+    }
+    if (r > 0) {
+        cells |= frontier->row[r - 1][w];
+    }
+    if (r < tron->data->height - 1) {
+        cells |= frontier->row[r + 1][w];
+    }
+    return cells;
+}
+
+// scores a position for the player at me by the cells it reaches before the
+// player at them, cells both reach at once count for neither
+// note:
+//  - both players grow a step at a time over the rows the frontiers can have
+//    reached, rows outside that are never written so they stay empty
+static int territory(struct tron_t* tron, struct location_t* me, struct location_t* them) {
+    struct bits_t bits[5];
+    struct bits_t* mine = &bits[0];
+    struct bits_t* theirs = &bits[1];
+    struct bits_t* next_mine = &bits[2];
+    struct bits_t* next_theirs = &bits[3];
+    struct bits_t* claimed = &bits[4];
+    struct bits_t* swap;
+    int top = me->row < them->row ? me->row : them->row;
+    int bottom = me->row > them->row ? me->row : them->row;
+    int score = 0;
+    uint64_t grew = 1;
+    memset(bits, 0, sizeof(bits));
+    set_bit(mine, me, 1);
+    set_bit(theirs, them, 1);
+    set_bit(claimed, me, 1);
+    set_bit(claimed, them, 1);
+    while (grew) {
+        // big boards take a while to fill, the deadline holds here too
+        if (tron->search.deadline && cpu_clock() >= tron->search.deadline) {
+            tron->search.aborted = 1;
+            break;
+        }
+        grew = 0;
+        top -= top > 0;
+        bottom += bottom < tron->data->height - 1;
+        for (int r = top; r <= bottom; r++) {
+            for (int w = 0; w < ROW_WORDS; w++) {
+                uint64_t free = tron->state.open.row[r][w] & ~claimed->row[r][w];
+                uint64_t a = spread(tron, mine, r, w) & free;
+                uint64_t b = spread(tron, theirs, r, w) & free;
+                uint64_t both = a & b;
+                claimed->row[r][w] |= a | b;
+                a &= ~both;
+                b &= ~both;
+                next_mine->row[r][w] = a;
+                next_theirs->row[r][w] = b;
+                score += __builtin_popcountll(a) - __builtin_popcountll(b);
+                grew |= a | b;
+            }
+        }
+        swap = mine;
+        mine = next_mine;
+        next_mine = swap;
+        swap = theirs;
+        theirs = next_theirs;
+        next_theirs = swap;
+    }
+    return score;
+}
+
+// searches both players moving at once for depth more moves, the player at
+// me picks the move that does best against every reply from them
+// note:
+//  - the search stops where it is once the deadline passes and the result
+//    is thrown away, only complete depths are used
+static int search(struct tron_t* tron, struct location_t* me, struct location_t* them, int depth, int alpha, int beta) {
+    struct location_t mine[dir_count];
+    struct location_t theirs[dir_count];
+    int my_moves = 0;
+    int their_moves = 0;
+    int best = -CPU_WIN;
+    tron->search.nodes++;
+    if (tron->search.deadline && cpu_clock() >= tron->search.deadline) {
+        tron->search.aborted = 1;
+        return 0;
+    }
+    for (int d = 0; d < dir_count; d++) {
+        step(me, d, &mine[my_moves]);
+        my_moves += get_bit(tron, &tron->state.open, &mine[my_moves]);
+        step(them, d, &theirs[their_moves]);
+        their_moves += get_bit(tron, &tron->state.open, &theirs[their_moves]);
+    }
+    // a player with nowhere to go crashes, a draw if both do
+    if (!my_moves || !their_moves) {
+        return my_moves ? CPU_WIN : their_moves ? -CPU_WIN : 0;
+    }
+    if (!depth) {
+        return territory(tron, me, them);
+    }
+    for (int m = 0; m < my_moves && !tron->search.aborted; m++) {
+        int worst = CPU_WIN;
+        set_bit(&tron->state.open, &mine[m], 0);
+        for (int t = 0; t < their_moves && !tron->search.aborted && worst > alpha; t++) {
+            int score = 0;
+            // riding into the same cell crashes both
+            if (mine[m].row != theirs[t].row || mine[m].col != theirs[t].col) {
+                set_bit(&tron->state.open, &theirs[t], 0);
+                score = search(tron, &mine[m], &theirs[t], depth - 1, alpha, worst);
+                set_bit(&tron->state.open, &theirs[t], 1);
+            }
+            worst = score < worst ? score : worst;
+        }
+        set_bit(&tron->state.open, &mine[m], 1);
+        best = worst > best ? worst : best;
+        alpha = best > alpha ? best : alpha;
+        if (alpha >= beta) {
+            break;
+        }
+    }
+    return best;
+}
+
+// picks the direction for a computer player, deepening the search until
+// the time for this tick is used up
+static enum e_keystroke cpu_move(struct tron_t* tron, int player, enum e_keystroke dir) {
+    struct location_t* me = player ? &tron->state.player2_loc : &tron->state.player1_loc;
+    struct location_t* them = player ? &tron->state.player1_loc : &tron->state.player2_loc;
+    struct location_t first;
+    struct location_t reply;
+    int best_dir = -1;
+    // keep going straight unless something better is found, or take any way
+    // out if straight crashes and there is no time to search
+    for (int d = 0; d < dir_count; d++) {
+        step(me, d, &first);
+        if (get_bit(tron, &tron->state.open, &first) && (best_dir < 0 || Player_Keys[player][d] == dir)) {
+            best_dir = d;
+        }
+    }
+    tron->search.aborted = 0;
+    // the time is shared when the computer rides both bikes
+    tron->search.deadline = tron->data->headless ? 0 : cpu_clock() +
+        TICK_NSEC(tron->data->speed) * TRON_CPU_BUDGET_PERCENT / 100 / (tron->cpu == 3 ? 2 : 1);
+    tron->search.max_depth = tron->data->headless ? TRON_CPU_HEADLESS_DEPTH : TRON_CPU_MAX_DEPTH;
+    for (int depth = 0; depth < tron->search.max_depth && !tron->search.aborted; depth++) {
+        int depth_dir = -1;
+        int alpha = -CPU_WIN - 1;
+        // the best move from the last depth is tried first
+        for (int i = -1; i < dir_count && !tron->search.aborted; i++) {
+            int d = i < 0 ? best_dir : i;
+            int worst = CPU_WIN;
+            if (d < 0 || (i >= 0 && d == best_dir)) {
+                continue;
+            }
+            step(me, d, &first);
+            if (!get_bit(tron, &tron->state.open, &first)) {
+                continue;
+            }
+            set_bit(&tron->state.open, &first, 0);
+            for (int t = 0; t < dir_count && !tron->search.aborted && worst > alpha; t++) {
+                int score = 0;
+                step(them, t, &reply);
+                if (!get_bit(tron, &tron->state.open, &reply)) {
+                    score = CPU_WIN;
+                }
+                else if (first.row != reply.row || first.col != reply.col) {
+                    set_bit(&tron->state.open, &reply, 0);
+                    score = search(tron, &first, &reply, depth, alpha, worst);
+                    set_bit(&tron->state.open, &reply, 1);
+                }
+                worst = score < worst ? score : worst;
+            }
+            set_bit(&tron->state.open, &first, 1);
+            if (worst > alpha) {
+                alpha = worst;
+                depth_dir = d;
+            }
+        }
+        if (!tron->search.aborted && depth_dir >= 0) {
+            best_dir = depth_dir;
+        }
+        // a forced win or loss will not change with more depth
+        if (alpha >= CPU_WIN || alpha <= -CPU_WIN) {
+            break;
+        }
+    }
+    return best_dir < 0 ? dir : Player_Keys[player][best_dir];
 }
 
 // paints the line based on the previous keystroke
-static inline void paint_line(struct location_t* loc, enum e_keystroke prev, enum e_keystroke new) {
-    paint_char(loc, prev & new & (ascii_up | arrow_up | ascii_down | arrow_down)
-            ? tron.vertical_char : tron.horizontal_char);
+static inline void paint_line(struct tron_t* tron, struct location_t* loc, enum e_keystroke prev, enum e_keystroke new) {
+    paint_char(tron->data, loc, prev & new & (ascii_up | arrow_up | ascii_down | arrow_down)
+            ? tron->vertical_char : tron->horizontal_char);
+}
+
+
+// keeps both bikes of a world in view as best it can
+static inline void follow_players(struct tron_t* tron) {
+    struct location_t middle;
+    middle.row = (tron->state.player1_loc.row + tron->state.player2_loc.row) / 2;
+    middle.col = (tron->state.player1_loc.col + tron->state.player2_loc.col) / 2;
+    follow_location(tron->data, &middle);
 }
 
 
 // resets the tron game
-static int tron_reset(void) {
-    // reset the tron data
-    int x = Data->width / 10;
-    int y = Data->height - 1;
-    tron.player1_dir = ascii_up;
-    tron.player2_dir = arrow_up;
-    tron.player1_loc.row = y;
-    tron.player1_loc.col = x;
-    tron.player2_loc.row = y;
-    tron.player2_loc.col = Data->width - 1 - x;
-    *tron.over_message = '\0';
+static int tron_reset(struct carcade_t* data) {
+    struct tron_t* tron = data->game;
+    // reset the tron data, a world starts as the biggest board in its middle
+    int width = data->width < MAX_WIDTH ? data->width : MAX_WIDTH;
+    int height = data->height < MAX_HEIGHT ? data->height : MAX_HEIGHT;
+    int top = (data->height - height) / 2;
+    int left = (data->width - width) / 2;
+    int x = width / 10;
+    int y = height - 1;
+    tron->state.player1_dir = ascii_up;
+    tron->state.player2_dir = arrow_up;
+    tron->state.player1_loc.row = top + y;
+    tron->state.player1_loc.col = left + x;
+    tron->state.player2_loc.row = top + y;
+    tron->state.player2_loc.col = left + width - 1 - x;
+    *tron->state.over_message = '\0';
+    // every cell is open but the starting ones
+    if (!tron->world) {
+        memset(&tron->state.open, 0, sizeof(tron->state.open));
+        for (int r = 0; r < data->height; r++) {
+            for (int c = 0; c < data->width; c++) {
+                tron->state.open.row[r][c / 64] |= (uint64_t)1 << (c % 64);
+            }
+        }
+        set_bit(&tron->state.open, &tron->state.player1_loc, 0);
+        set_bit(&tron->state.open, &tron->state.player2_loc, 0);
+    }
+    else {
+        occupy_world_cell(data, &tron->state.player1_loc, 1);
+        occupy_world_cell(data, &tron->state.player2_loc, 1);
+    }
+    // both players count the games and ticks from the start the same way
+    if (tron->net.fd >= 0) {
+        tron->net.game++;
+        tron->net.frame = 0;
+        tron->net.sent = 0;
+        tron->net.received = 0;
+        tron->net.rollback_from = ~0u;
+        tron->net.pending = 0;
+    }
     // clear keys
-    Data->key = arrow_up | ascii_up;
-    clear_keystroke();
+    data->key = arrow_up | ascii_up;
+    clear_keystroke(data);
     // paint the start
-    paint_char(&tron.player1_loc, tron.player1_char);
-    paint_char(&tron.player2_loc, tron.player2_char);
+    paint_char(data, &tron->state.player1_loc, tron->player1_char);
+    paint_char(data, &tron->state.player2_loc, tron->player2_char);
+    follow_players(tron);
     return 0;
 }
 
 
-// moves the tron players in their respective directions
-static int tron_move(enum e_keystroke next) {
+// plays out one tick of both players turning with their keys and moving on,
+// the screen is left alone so a tick can be played again
+static int play_frame(struct tron_t* tron, enum e_keystroke p1_key, enum e_keystroke p2_key) {
+    struct tron_state_t* state = &tron->state;
     int ret = 0;
     int res1;
     int res2;
@@ -109,56 +521,388 @@ static int tron_move(enum e_keystroke next) {
     enum e_keystroke p2_new_dir;
     struct location_t p1_new_loc;
     struct location_t p2_new_loc;
-    // if its a quit key do nothing
-    if (next & carcade_quit) {
-        return CARCADE_GAME_QUIT;
-    }
     // can't double back, keep going the same direction if the next is
     // immediately backwards
-    p1_new_dir = turn_player(tron.player1_dir, next & arrow_clear);
-    p2_new_dir = turn_player(tron.player2_dir, next & ascii_clear);
+    p1_new_dir = turn_player(state->player1_dir, p1_key);
+    p2_new_dir = turn_player(state->player2_dir, p2_key);
     // make both moves
-    res1 = advance_player(&tron.player1_loc, p1_new_dir, &p1_new_loc);
-    res2 = advance_player(&tron.player2_loc, p2_new_dir, &p2_new_loc);
+    res1 = advance_player(tron, &state->player1_loc, p1_new_dir, &p1_new_loc);
+    res2 = advance_player(tron, &state->player2_loc, p2_new_dir, &p2_new_loc);
     // if both game over or if both result in the same position...
     if ((res1 == CARCADE_GAME_OVER && res2 == CARCADE_GAME_OVER) ||
-            p1_new_loc.row == p2_new_loc.row && p1_new_loc.col == p2_new_loc.col) {
-        *tron.over_message = '\0';
+            (p1_new_loc.row == p2_new_loc.row && p1_new_loc.col == p2_new_loc.col)) {
+        *state->over_message = '\0';
         ret = CARCADE_GAME_OVER;
     }
     else if (res1 == CARCADE_GAME_OVER) {
-        memcpy(tron.over_message, TRON_P2_WIN_MESSAGE, strlen(TRON_P2_WIN_MESSAGE) + 1);
+        memcpy(state->over_message, TRON_P2_WIN_MESSAGE, strlen(TRON_P2_WIN_MESSAGE) + 1);
         ret = CARCADE_GAME_OVER;
     }
     else if (res2 == CARCADE_GAME_OVER) {
-        memcpy(tron.over_message, TRON_P1_WIN_MESSAGE, strlen(TRON_P1_WIN_MESSAGE) + 1);
+        memcpy(state->over_message, TRON_P1_WIN_MESSAGE, strlen(TRON_P1_WIN_MESSAGE) + 1);
         ret = CARCADE_GAME_OVER;
     }
-    // paint over old positions
-    paint_line(&tron.player1_loc, tron.player1_dir, p1_new_dir);
-    paint_line(&tron.player2_loc, tron.player2_dir, p2_new_dir);
     // overwrite current positions
-    tron.player1_dir = p1_new_dir;
-    tron.player2_dir = p2_new_dir;
-    tron.player1_loc.row = p1_new_loc.row;
-    tron.player1_loc.col = p1_new_loc.col;
-    tron.player2_loc.row = p2_new_loc.row;
-    tron.player2_loc.col = p2_new_loc.col;
+    state->player1_dir = p1_new_dir;
+    state->player2_dir = p2_new_dir;
+    state->player1_loc = p1_new_loc;
+    state->player2_loc = p2_new_loc;
+    if (!ret && !tron->world) {
+        set_bit(&state->open, &state->player1_loc, 0);
+        set_bit(&state->open, &state->player2_loc, 0);
+    }
+    else if (!ret) {
+        occupy_world_cell(tron->data, &state->player1_loc, 1);
+        occupy_world_cell(tron->data, &state->player2_loc, 1);
+    }
+    return ret;
+}
+
+// paints a tick played out from the state before it
+static void paint_frame(struct tron_t* tron, struct tron_state_t* before) {
+    struct tron_state_t* state = &tron->state;
+    // paint over old positions
+    paint_line(tron, &before->player1_loc, before->player1_dir, state->player1_dir);
+    paint_line(tron, &before->player2_loc, before->player2_dir, state->player2_dir);
     // paint new positions
-    paint_char(&tron.player1_loc, tron.player1_char);
-    paint_char(&tron.player2_loc, tron.player2_char);
+    paint_char(tron->data, &state->player1_loc, tron->player1_char);
+    paint_char(tron->data, &state->player2_loc, tron->player2_char);
+}
+
+
+// turns the keys of either player into the directions sent, the arrow keys
+static inline uint16_t net_key(enum e_keystroke key) {
+    return (key | key >> 4) & ~arrow_clear;
+}
+
+// sends the queued inputs that have waited out the simulated lag by now
+static void net_flush(struct net_t* net, long long now) {
+    struct net_outgoing_t* out;
+    while (net->out_head != net->out_tail && !net->closed) {
+        out = &net->outgoing[net->out_head % (2 * TRON_NET_ROLLBACK)];
+        if (out->due > now) {
+            break;
+        }
+        if (send(net->fd, &out->input, sizeof(out->input), MSG_NOSIGNAL) != sizeof(out->input)) {
+            net->closed = 1;
+        }
+        net->out_head++;
+    }
+}
+
+// queues the local input for a tick, sent once the simulated lag is over
+// note:
+//  - the other player is at most TRON_NET_ROLLBACK ticks past the inputs
+//    it has and this player past its inputs, so no more than twice that
+//    are ever queued
+static void net_send(struct net_t* net, uint32_t frame, uint16_t key) {
+    unsigned int slot = net->out_tail % (2 * TRON_NET_ROLLBACK);
+    long long due = cpu_clock() + net->lag_ms * 1000000LL;
+    if (net->jitter_ms) {
+        due += rand_r(&net->jitter_seed) % (net->jitter_ms + 1) * 1000000LL;
+    }
+    // the stream keeps the inputs in order however the lag falls
+    if (net->out_head != net->out_tail) {
+        long long last = net->outgoing[(net->out_tail - 1) % (2 * TRON_NET_ROLLBACK)].due;
+        due = due < last ? last : due;
+    }
+    net->outgoing[slot].due = due;
+    net->outgoing[slot].input.game = htons(net->game);
+    net->outgoing[slot].input.key = htons(key);
+    net->outgoing[slot].input.frame = htonl(frame);
+    net->out_tail++;
+    net_flush(net, cpu_clock());
+}
+
+// reads the other player's inputs and finds the first one that was guessed
+// wrong, the link is closed once the other player is gone
+static void net_receive(struct net_t* net) {
+    struct net_input_t input;
+    uint32_t frame;
+    uint16_t key;
+    ssize_t len;
+    while (!net->closed) {
+        if (net->message_len < sizeof(input)) {
+            len = recv(net->fd, net->message + net->message_len,
+                    sizeof(input) - net->message_len, MSG_DONTWAIT);
+            if (len > 0) {
+                net->message_len += len;
+            }
+            else if (!len || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                net->closed = 1;
+            }
+            else {
+                break;
+            }
+            continue;
+        }
+        memcpy(&input, net->message, sizeof(input));
+        // the ticks played past the end of the last game are dropped and the
+        // next game's wait for it to start
+        if (ntohs(input.game) != net->game) {
+            if ((int16_t)(ntohs(input.game) - net->game) > 0) {
+                break;
+            }
+            net->message_len = 0;
+            continue;
+        }
+        net->message_len = 0;
+        frame = ntohl(input.frame);
+        key = ntohs(input.key);
+        if (frame != net->received) {
+            net->closed = 1;
+            break;
+        }
+        net->remote[frame % (2 * TRON_NET_ROLLBACK)] = key;
+        net->received++;
+        if (frame < net->frame && key != net->guess[frame % TRON_NET_ROLLBACK] &&
+                frame < net->rollback_from) {
+            net->rollback_from = frame;
+        }
+    }
+}
+
+// waits for the other player's input or for the next queued input to be due
+static void net_wait(struct net_t* net) {
+    struct pollfd fd = { net->fd, POLLIN, 0 };
+    long long wait;
+    int timeout = -1;
+    if (net->out_head != net->out_tail) {
+        wait = net->outgoing[net->out_head % (2 * TRON_NET_ROLLBACK)].due - cpu_clock();
+        timeout = wait > 0 ? (wait + 999999) / 1000000 : 0;
+    }
+    poll(&fd, 1, timeout);
+}
+
+// plays the next tick with the local input and the other player's, guessing
+// no turn if it has not arrived, returns NET_WAIT without playing it if it
+// would end the game on a guess
+static int net_play(struct tron_t* tron) {
+    struct net_t* net = &tron->net;
+    uint32_t frame = net->frame;
+    struct tron_state_t* before = &net->snapshots[frame % TRON_NET_ROLLBACK];
+    uint16_t local = net->local[frame % TRON_NET_ROLLBACK];
+    uint16_t remote = frame < net->received ? net->remote[frame % (2 * TRON_NET_ROLLBACK)] : 0;
+    int ret;
+    *before = tron->state;
+    net->guess[frame % TRON_NET_ROLLBACK] = remote;
+    ret = net->player ? play_frame(tron, remote << 4, local) : play_frame(tron, local << 4, remote);
+    if (ret && frame >= net->received) {
+        tron->state = *before;
+        return NET_WAIT;
+    }
+    paint_frame(tron, before);
+    net->frame++;
+    return ret;
+}
+
+// plays the game again from the first tick played on a wrong guess up to
+// where it was, returns as playing a tick does
+static int net_rollback(struct tron_t* tron) {
+    struct net_t* net = &tron->net;
+    struct carcade_t* data = tron->data;
+    struct tron_state_t* from = &net->snapshots[net->rollback_from % TRON_NET_ROLLBACK];
+    struct location_t loc;
+    uint32_t end = net->frame;
+    long long start = cpu_clock();
+    uint64_t taken;
+    int ret = 0;
+    // take what was ridden since off the screen and put the bikes back
+    for (loc.row = 0; loc.row < data->height; loc.row++) {
+        for (int w = 0; w < ROW_WORDS; w++) {
+            taken = from->open.row[loc.row][w] & ~tron->state.open.row[loc.row][w];
+            while (taken) {
+                loc.col = w * 64 + __builtin_ctzll(taken);
+                taken &= taken - 1;
+                paint_char(data, &loc, data->clear_char);
+            }
+        }
+    }
+    paint_char(data, &from->player1_loc, tron->player1_char);
+    paint_char(data, &from->player2_loc, tron->player2_char);
+    tron->state = *from;
+    net->frame = net->rollback_from;
+    net->rollback_from = ~0u;
+    net->rollbacks++;
+    net->rolled_back += end - net->frame;
+    if (end - net->frame > net->max_rolled_back) {
+        net->max_rolled_back = end - net->frame;
+    }
+    while (!ret && net->frame < end) {
+        ret = net_play(tron);
+    }
+    if (cpu_clock() - start > net->max_rollback_nsec) {
+        net->max_rollback_nsec = cpu_clock() - start;
+    }
+    return ret;
+}
+
+// plays this tick against the other player over the network
+// note:
+//  - a tick stuck waiting on the other player plays nothing, the local
+//    keys carry over to the next one decided
+//  - headless games wait here instead so every move plays one tick
+static int net_move(struct tron_t* tron, uint16_t key) {
+    struct net_t* net = &tron->net;
+    int ret;
+    if (key) {
+        net->pending = key;
+    }
+    while (1) {
+        net_flush(net, cpu_clock());
+        net_receive(net);
+        ret = net->rollback_from < net->frame ? net_rollback(tron) : 0;
+        // once the other player is gone the game is over where its inputs end
+        if (ret != CARCADE_GAME_OVER && net->closed && net->frame >= net->received) {
+            memcpy(tron->state.over_message, TRON_NET_LEFT_MESSAGE, strlen(TRON_NET_LEFT_MESSAGE) + 1);
+            return CARCADE_GAME_OVER;
+        }
+        // a new tick takes the latest local keys unless too far ahead
+        if (!ret && net->frame == net->sent && net->sent < net->received + TRON_NET_ROLLBACK) {
+            net->local[net->sent % TRON_NET_ROLLBACK] = net->pending;
+            net_send(net, net->sent++, net->pending);
+            net->pending = 0;
+        }
+        if (!ret) {
+            ret = net->frame < net->sent ? net_play(tron) : NET_WAIT;
+        }
+        if (ret != NET_WAIT) {
+            return ret;
+        }
+        if (!tron->data->headless) {
+            return 0;
+        }
+        net_wait(net);
+    }
+}
+
+// connects to the other player, hosting if there is no host to join, and
+// checks both are on the same board, returns 0 on success
+static int net_connect(struct tron_t* tron, const char* host, const char* port) {
+    struct net_t* net = &tron->net;
+    struct addrinfo hints;
+    struct addrinfo* addrs;
+    struct addrinfo* addr;
+    struct net_hello_t hello;
+    struct net_hello_t other;
+    int one = 1;
+    int fd;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = host ? AF_UNSPEC : AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = host ? 0 : AI_PASSIVE;
+    if (getaddrinfo(host, port, &hints, &addrs)) {
+        return -1;
+    }
+    for (addr = addrs; addr && net->fd < 0; addr = addr->ai_next) {
+        if ((fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0) {
+            continue;
+        }
+        if (host) {
+            if (!connect(fd, addr->ai_addr, addr->ai_addrlen)) {
+                net->fd = fd;
+                continue;
+            }
+        }
+        else {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (!bind(fd, addr->ai_addr, addr->ai_addrlen) && !listen(fd, 1)) {
+                printf("waiting for the other player on port %s\n", port);
+                fflush(stdout);
+                net->fd = accept(fd, NULL, NULL);
+            }
+        }
+        close(fd);
+    }
+    freeaddrinfo(addrs);
+    if (net->fd < 0) {
+        return -1;
+    }
+    setsockopt(net->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    net->player = host ? 1 : 0;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, TRON_NET_MAGIC, sizeof(hello.magic));
+    hello.width = htons(tron->data->width);
+    hello.height = htons(tron->data->height);
+    hello.speed = htons(tron->data->speed);
+    if (send(net->fd, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello) ||
+            recv(net->fd, &other, sizeof(other), MSG_WAITALL) != sizeof(other)) {
+        return -1;
+    }
+    return memcmp(&hello, &other, sizeof(hello)) ? -1 : 0;
+}
+
+// moves the tron players in their respective directions
+static int tron_move(struct carcade_t* data, enum e_keystroke next) {
+    struct tron_t* tron = data->game;
+    struct tron_state_t before = tron->state;
+    enum e_keystroke p1_key = next & arrow_clear;
+    enum e_keystroke p2_key = next & ascii_clear;
+    int ret;
+    // if its a quit key do nothing
+    if (next & carcade_quit) {
+        return CARCADE_GAME_QUIT;
+    }
+    // the computer players both decide on the board as it is now
+    if (tron->cpu & 1) {
+        p1_key = cpu_move(tron, 0, tron->state.player1_dir);
+    }
+    if (tron->cpu & 2) {
+        p2_key = cpu_move(tron, 1, tron->state.player2_dir);
+    }
+    // over the network the local player rides with either keys
+    if (tron->net.fd >= 0) {
+        if (tron->cpu) {
+            next = tron->net.player ? p2_key : p1_key;
+        }
+        return net_move(tron, net_key(next));
+    }
+    ret = play_frame(tron, p1_key, p2_key);
+    paint_frame(tron, &before);
+    // a bike that crashed may be off the board, the view stays put
+    if (!ret) {
+        follow_players(tron);
+    }
     return ret;
 }
 
+// hangs up on the other player and reports how much was played again
+static void tron_stop(struct carcade_t* data) {
+    struct tron_t* tron = data->game;
+    struct net_t* net = &tron->net;
+    // the last inputs are owed to the other player whatever the lag
+    net_flush(net, LLONG_MAX);
+    close(net->fd);
+    net->fd = -1;
+    if (data->headless && !data->quiet) {
+        printf("netplay: %lld rollbacks played %lld ticks again, at most %d at once, "
+                "the longest took %.3f ms\n", net->rollbacks, net->rolled_back,
+                net->max_rolled_back, net->max_rollback_nsec / 1e6);
+    }
+}
+
 // prints the winner if there is one
-static int tron_over(void) {
-    if (*tron.over_message) {
-        paint_center_text((Data->height / 2) - 1, tron.over_message);
+static int tron_over(struct carcade_t* data) {
+    struct tron_t* tron = data->game;
+    if (*tron->state.over_message) {
+        paint_center_text(data, (data->height / 2) - 1, tron->state.over_message);
         return 0;
     }
     return 1;
 }
 
+// copies the players into a snapshot
+static void tron_save(struct carcade_t* data, void* state) {
+    struct tron_t* tron = data->game;
+    memcpy(state, &tron->state, sizeof(tron->state));
+}
+
+// puts the players back from a snapshot
+static void tron_restore(struct carcade_t* data, const void* state) {
+    struct tron_t* tron = data->game;
+    memcpy(&tron->state, state, sizeof(tron->state));
+}
+
 
 
 // ----- tron.h ----------------------------------------------------------------
@@ -171,49 +915,118 @@ void print_tron_help(void) {
             TRON_P1_ARG           "\tchar - the player1 bike style\n\t"
             TRON_P2_ARG           "\tchar - the player2 bike style\n\t"
             TRON_VERTICAL_ARG   "\t\tchar - the bike trail style moving vertically\n\t"
-            TRON_HORIZONTAL_ARG "\t\tchar - the bike trail style moving horizontally\n\n");
+            TRON_HORIZONTAL_ARG "\t\tchar - the bike trail style moving horizontally\n\t"
+            TRON_CPU_ARG        "\t\tint  - the player the computer rides, 1, 2 or 3 for both\n\t"
+            TRON_HOST_ARG       "\tport - wait for the other player to join and ride player1\n\t"
+            TRON_JOIN_ARG       "\thost:port - join the other player and ride player2\n\t"
+            TRON_LAG_ARG        "\t\tms   - the lag added to every tick sent over the network\n\t"
+            TRON_JITTER_ARG     "\tms   - the most lag added at random on top of that\n\n");
 
 }
 
 // sets up the data for a new tron game
 int new_tron(struct carcade_t* data, int argc, char** argv) {
-    Data = data;
-    tron.player1_char = TRON_DEFAULT_P1_CHAR;
-    tron.player2_char = TRON_DEFAULT_P2_CHAR;
-    tron.vertical_char = TRON_DEFAULT_VERTICAL_CHAR;
-    tron.horizontal_char = TRON_DEFAULT_HORIZONTAL_CHAR;
+    struct tron_t* tron = data->game = calloc(1, sizeof(*tron));
+    char host[MAX_STRLEN] = "";
+    char* port = NULL;
+    int joining = 0;
+    if (!tron) {
+        printf("error: could not set up the tron players\n");
+        return CARCADE_GAME_QUIT;
+    }
+    tron->data = data;
+    tron->player1_char = TRON_DEFAULT_P1_CHAR;
+    tron->player2_char = TRON_DEFAULT_P2_CHAR;
+    tron->vertical_char = TRON_DEFAULT_VERTICAL_CHAR;
+    tron->horizontal_char = TRON_DEFAULT_HORIZONTAL_CHAR;
+    tron->cpu = TRON_DEFAULT_CPU;
+    tron->net.fd = -1;
     // parse out custom arguments
     for (int i = 0; i < argc - 1; i++) {
         if (!strcmp(TRON_P1_ARG, argv[i])) {
-            tron.player1_char = *argv[++i];
+            tron->player1_char = *argv[++i];
         }
         else if (!strcmp(TRON_P2_ARG, argv[i])) {
-            tron.player2_char = *argv[++i];
+            tron->player2_char = *argv[++i];
         }
         else if (!strcmp(TRON_VERTICAL_ARG, argv[i])) {
-            tron.vertical_char = *argv[++i];
+            tron->vertical_char = *argv[++i];
         }
         else if (!strcmp(TRON_HORIZONTAL_ARG, argv[i])) {
-            tron.horizontal_char = *argv[++i];
+            tron->horizontal_char = *argv[++i];
+        }
+        else if (!strcmp(TRON_CPU_ARG, argv[i])) {
+            tron->cpu = atoi(argv[++i]);
+        }
+        else if (!strcmp(TRON_HOST_ARG, argv[i])) {
+            port = argv[++i];
+        }
+        else if (!strcmp(TRON_JOIN_ARG, argv[i])) {
+            strncpy(host, argv[++i], MAX_STRLEN - 1);
+            if ((port = strrchr(host, ':'))) {
+                *port++ = '\0';
+            }
+            joining = 1;
+        }
+        else if (!strcmp(TRON_LAG_ARG, argv[i])) {
+            tron->net.lag_ms = atoi(argv[++i]);
+        }
+        else if (!strcmp(TRON_JITTER_ARG, argv[i])) {
+            tron->net.jitter_ms = atoi(argv[++i]);
         }
     }
-    if (!tron.player1_char || !tron.player2_char || !tron.vertical_char || !tron.horizontal_char ||
-            tron.player1_char == tron.player2_char ||
-            tron.vertical_char == Data->clear_char || tron.horizontal_char == Data->clear_char) {
+    if (!tron->player1_char || !tron->player2_char || !tron->vertical_char || !tron->horizontal_char ||
+            tron->player1_char == tron->player2_char || tron->cpu < 0 || tron->cpu > 3 ||
+            tron->vertical_char == data->clear_char || tron->horizontal_char == data->clear_char) {
         printf("error: something went wrong with the tron arguments\n");
-        return CARCADE_GAME_QUIT;
+        goto fail;
+    }
+    // the computer and netplay look ahead and roll back on the open cells,
+    // which only cover a board shown whole
+    tron->world = IS_WORLD(data->width, data->height);
+    if (tron->world && (tron->cpu || port)) {
+        printf("error: tron on a world is ridden by two players at one keyboard\n");
+        goto fail;
+    }
+    // the computer can only ride the local player and the other player's
+    // keys are never recorded
+    if (port && (tron->net.lag_ms < 0 || tron->net.jitter_ms < 0 || data->record || data->replay ||
+                (tron->cpu & ~(1 << joining)))) {
+        printf("error: something went wrong with the tron netplay arguments\n");
+        goto fail;
+    }
+    if (port && net_connect(tron, joining ? host : NULL, port)) {
+        printf("error: could not play with the other player on port %s\n", port);
+        goto fail;
     }
     // set the title and function pointer data
     int len = strlen(TRON_TITLE);
-    memcpy(Data->title, TRON_TITLE, len);
-    Data->title[len] = '\0';
-    Data->ORkeys = 1;
-    Data->clear_board_buffer = 0; // tron remains mostly similar between paints
-    Data->keep_score = 0;
-    Data->reset = tron_reset;
-    Data->move = tron_move;
-    Data->over = tron_over;
+    memcpy(data->title, TRON_TITLE, len);
+    data->title[len] = '\0';
+    data->key_policy = key_policy_or;
+    data->clear_board_buffer = 0; // tron remains mostly similar between paints
+    data->keep_score = 0;
+    data->reset = tron_reset;
+    data->move = tron_move;
+    data->over = tron_over;
+    data->save = tron_save;
+    data->restore = tron_restore;
+    data->world = 1;
+    if (tron->net.fd >= 0) {
+        tron->net.game = ~0;
+        tron->net.jitter_seed = time(0) ^ getpid();
+        data->stop = tron_stop;
+    }
     return 0;
+
+fail:
+    // a connection can be left open by a greeting that did not match
+    if (tron->net.fd >= 0) {
+        close(tron->net.fd);
+    }
+    free(tron);
+    data->game = NULL;
+    return CARCADE_GAME_QUIT;
 }
 
 
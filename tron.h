@@ -21,6 +21,32 @@
 #define TRON_HORIZONTAL_ARG "-htrail"
 #define TRON_DEFAULT_HORIZONTAL_CHAR '-'
 
+// the computer players, 1 or 2 for one player or 3 for both
+#define TRON_CPU_ARG "-tron-cpu"
+#define TRON_DEFAULT_CPU 0
+
+// the share of each tick the computer can think for and how deep it looks
+// when headless, where it has to play the same way every run
+#define TRON_CPU_BUDGET_PERCENT 30
+#define TRON_CPU_MAX_DEPTH 64
+#define TRON_CPU_HEADLESS_DEPTH 1
+
+// netplay, the host waits for the other player and rides player 1 while the
+// other joins it at host:port and rides player 2, either with any keys
+#define TRON_HOST_ARG "-tron-host"
+#define TRON_JOIN_ARG "-tron-join"
+
+// milliseconds added to every message sent and up to how many more at random,
+// to try out a slow link on one machine
+#define TRON_LAG_ARG "-tron-lag"
+#define TRON_JITTER_ARG "-tron-jitter"
+
+// the ticks a player can get ahead of the other player's inputs, every one of
+// them is played on a guess and played again if the guess was wrong
+#define TRON_NET_ROLLBACK 64
+#define TRON_NET_MAGIC "TRN1"
+#define TRON_NET_LEFT_MESSAGE " PLAYER LEFT "
+
 #define TRON_P1_WIN_MESSAGE " P1 WINS! "
 #define TRON_P2_WIN_MESSAGE " P2 WINS! "
 #define TRON_MAX_MESSAGE_LEN 16